@@ -0,0 +1,419 @@
+#include "assetpack.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <string_view>
+#include <filesystem>
+
+const char* ASSET_PACK_MAGIC = "YLNDPACK";
+const char* ASSET_PACK_EXT = ".pack";
+
+AssetPack asset_pack;
+
+uint64_t appendBlob(std::vector<char>& data, const void* source, size_t size) {
+	// Keep every blob 8 byte aligned so records can be read in place
+	uint64_t offset = (data.size() + 7) & ~(uint64_t)7;
+	data.resize(offset + size);
+	if (size > 0) std::memcpy(data.data() + offset, source, size);
+	return offset;
+}
+
+void packModel(std::vector<char>& data, const std::string& path, const ObjWavefront& obj, AssetPackModel& model) {
+	int material_index;
+	const ObjGeometry& geometry = *obj.geometry;
+	std::vector<AssetPackSurface> surfaces;
+	std::vector<AssetPackMaterial> materials;
+	std::vector<AssetPackMaterialRef> material_refs;
+	std::unordered_map<std::string, int> material_indices;
+
+	std::memset(&model, 0, sizeof(AssetPackModel));
+	model.path_size = path.size();
+	model.path_offset = appendBlob(data, path.data(), path.size());
+	model.name_size = obj.name.size();
+	model.name_offset = appendBlob(data, obj.name.data(), obj.name.size());
+	model.vert_count = geometry.verts.size();
+	model.verts_offset = appendBlob(data, geometry.verts.data(), sizeof(Vector3) * geometry.verts.size());
+	model.norm_count = geometry.norms.size();
+	model.norms_offset = appendBlob(data, geometry.norms.data(), sizeof(Vector3) * geometry.norms.size());
+	model.uv_count = geometry.uvs.size();
+	model.uvs_offset = appendBlob(data, geometry.uvs.data(), sizeof(Vector2) * geometry.uvs.size());
+
+	for (auto& [name, material] : obj.materials) {
+		AssetPackMaterial packed;
+		std::memset(&packed, 0, sizeof(AssetPackMaterial));
+		packed.name_size = name.size();
+		packed.name_offset = appendBlob(data, name.data(), name.size());
+		packed.illum_model = (int32_t)material.illum_model;
+		packed.dissolve = material.dissolve;
+		packed.optical_density = material.optical_density;
+		packed.spec_exp = material.spec_exp;
+		std::memcpy(packed.ambient, &material.ambient, sizeof(packed.ambient));
+		std::memcpy(packed.diffuse, &material.diffuse, sizeof(packed.diffuse));
+		std::memcpy(packed.specular, &material.specular, sizeof(packed.specular));
+		std::memcpy(packed.emissive, &material.emissive, sizeof(packed.emissive));
+		material_indices[name] = materials.size();
+		materials.push_back(packed);
+	}
+	model.material_count = materials.size();
+	model.materials_offset = appendBlob(data, materials.data(), sizeof(AssetPackMaterial) * materials.size());
+
+	for (const Surface& surface : geometry.surfaces) {
+		AssetPackSurface packed;
+		std::memset(&packed, 0, sizeof(AssetPackSurface));
+		packed.face_count = surface.faces.size();
+		packed.faces_offset = appendBlob(data, surface.faces.data(), sizeof(Face) * packed.face_count);
+
+		material_refs.clear();
+		for (const MaterialRange& range : surface.material_ranges) {
+			material_index = -1;
+			if (material_indices.find(range.name) != material_indices.end()) {
+				material_index = material_indices[range.name];
+			}
+			material_refs.push_back({range.face_start, material_index});
+		}
+		packed.material_ref_count = material_refs.size();
+		packed.material_refs_offset = appendBlob(
+			data, material_refs.data(), sizeof(AssetPackMaterialRef) * material_refs.size()
+		);
+		surfaces.push_back(packed);
+	}
+	model.surface_count = surfaces.size();
+	model.surfaces_offset = appendBlob(data, surfaces.data(), sizeof(AssetPackSurface) * surfaces.size());
+}
+
+/// Material libraries the OBJ loader will read (mtllib lines before the first object)
+void addMaterialLibraries(const std::string& path, std::vector<std::string>& files) {
+	const char* cursor;
+	const char* line_end;
+	const char* file_end;
+	std::string base_dir = f_base_dir(path.c_str());
+	std::string_view line;
+	MappedFile f;
+
+	if (!f.open(path.c_str())) return;
+	cursor = f.data;
+	file_end = f.data + f.size;
+	while (cursor < file_end) {
+		line_end = (const char*)std::memchr(cursor, '\n', file_end - cursor);
+		if (line_end == NULL) line_end = file_end;
+		line = std::string_view(cursor, line_end - cursor);
+		cursor = line_end + 1;
+		if (line.size() > 0 && line.back() == '\r') line.remove_suffix(1);
+		if (line.substr(0, 2) == "o ") break;
+		if (line.substr(0, 7) == "mtllib " && line.size() > 7) {
+			files.push_back(base_dir + std::string(line.substr(7)));
+		}
+	}
+}
+
+/// Write time and size of a source file, both 0 if it cannot be read
+void getSourceStamp(const std::string& path, int64_t& write_time, uint64_t& file_size) {
+	std::error_code ec;
+	std::filesystem::file_time_type time = std::filesystem::last_write_time(path, ec);
+	write_time = ec ? 0 : (int64_t)time.time_since_epoch().count();
+	file_size = std::filesystem::file_size(path, ec);
+	if (ec) file_size = 0;
+}
+
+void copyFloats(const json& item, const char* key, float* values, int count) {
+	if (!item.contains(key) || !item[key].is_array()) return;
+	for (int i = 0; i < count && i < item[key].size(); i++) {
+		if (item[key][i].is_number()) values[i] = item[key][i];
+	}
+}
+
+void AssetPack::build(const char* filename, const json& lookup, const json& blockdef, const std::vector<std::string>& source_files) {
+	int i;
+	uint64_t offset;
+	std::string path;
+	std::string key;
+	std::vector<std::string> paths;
+	std::vector<std::string> files(source_files);
+	std::unordered_map<std::string, int> model_indices;
+	std::vector<AssetPackBlock> blocks;
+	std::vector<AssetPackSource> sources;
+	std::vector<char> data;
+	AssetPackHeader header;
+	AssetPackModel model;
+	AssetPackBlock block;
+	std::ofstream f;
+
+	double s = timerStart();
+	std::cout << "Building asset pack \"" << filename << "\"..." << std::endl;
+
+	for (auto& [k1, item] : lookup.items()) {
+		if (!item.is_object()) continue;
+		for (auto& [k2, ref_path] : item.items()) {
+			if (!ref_path.is_string()) continue;
+			path = ref_path;
+			if (model_indices.find(path) != model_indices.end()) continue;
+			model_indices[path] = paths.size();
+			paths.push_back(path);
+		}
+	}
+
+	std::memset(&header, 0, sizeof(AssetPackHeader));
+	std::memcpy(header.magic, ASSET_PACK_MAGIC, sizeof(header.magic));
+	header.version = ASSET_PACK_VERSION;
+	header.model_count = paths.size();
+	header.bb_model_index = -1;
+	if (lookup["shapes"].contains("CCUBE")) {
+		header.bb_model_index = model_indices[lookup["shapes"]["CCUBE"]];
+	}
+	header.models_offset = sizeof(AssetPackHeader);
+	data.resize(header.models_offset + sizeof(AssetPackModel) * paths.size());
+
+	for (i = 0; i < paths.size(); i++) {
+		ObjWavefront obj;
+		obj.load(paths[i].c_str(), false);
+		packModel(data, paths[i], obj, model);
+		files.push_back(paths[i]);
+		addMaterialLibraries(paths[i], files);
+		offset = header.models_offset + sizeof(AssetPackModel) * i;
+		std::memcpy(data.data() + offset, &model, sizeof(AssetPackModel));
+	}
+	std::cout << "Packed " << paths.size() << " models" << std::endl;
+
+	// Resolve lookup per block the same way createMeshFromRef does
+	// (JSON objects iterate in key order, so blocks come out sorted)
+	for (auto& [block_key, item] : blockdef.items()) {
+		if (!item.is_object()) continue;
+		std::memset(&block, 0, sizeof(AssetPackBlock));
+		block.key_size = block_key.size();
+		block.key_offset = appendBlob(data, block_key.data(), block_key.size());
+		block.model_index = -1;
+		if (lookup["ids"].contains(block_key)) {
+			block.model_index = model_indices[lookup["ids"][block_key]];
+		} else if (item.contains("type") && lookup["types"].contains(item["type"])) {
+			block.model_index = model_indices[lookup["types"][item["type"]]];
+		} else if (item.contains("shape") && lookup["shapes"].contains(item["shape"])) {
+			block.model_index = model_indices[lookup["shapes"][item["shape"]]];
+			block.model_scaled = 1;
+		}
+		copyFloats(item, "size", block.size, 3);
+		copyFloats(item, "bb-center-offset", block.bb_center_offset, 3);
+		copyFloats(item, "bb-dimensions", block.bb_dimensions, 3);
+		// Only the primary color is used (see setEntityColor)
+		if (item.contains("colors") && item["colors"].is_array() && item["colors"].size() > 0) {
+			const json& color = item["colors"][0];
+			block.has_color = color.is_array() && color.size() >= 4;
+			for (i = 0; block.has_color && i < 4; i++) {
+				if (color[i].is_number()) block.color[i] = color[i];
+			}
+		}
+		blocks.push_back(block);
+	}
+	header.block_count = blocks.size();
+	header.blocks_offset = appendBlob(data, blocks.data(), sizeof(AssetPackBlock) * blocks.size());
+
+	for (const std::string& file : files) {
+		AssetPackSource source;
+		std::memset(&source, 0, sizeof(AssetPackSource));
+		source.path_size = file.size();
+		source.path_offset = appendBlob(data, file.data(), file.size());
+		getSourceStamp(file, source.write_time, source.file_size);
+		sources.push_back(source);
+	}
+	header.source_count = sources.size();
+	header.sources_offset = appendBlob(data, sources.data(), sizeof(AssetPackSource) * sources.size());
+	std::memcpy(data.data(), &header, sizeof(AssetPackHeader));
+
+	f = std::ofstream(filename, std::ios::out | std::ios::binary);
+	if (!f.is_open()) {
+		throw SaveException("Failed to open \"" + std::string(filename) + "\" for writing");
+	}
+	f.write(data.data(), data.size());
+	f.close();
+	if (f.fail()) {
+		throw SaveException("Failed to write \"" + std::string(filename) + "\"");
+	}
+
+	std::cout << "Packed " << blocks.size() << " block references" << std::endl;
+	std::cout << "Asset pack built (" << data.size() << " bytes)" << std::endl;
+	timerStopMsAndPrint(s);
+	std::cout << std::endl;
+}
+
+AssetPack::AssetPack() {
+	this->header = nullptr;
+	this->models = nullptr;
+	this->blocks = nullptr;
+	this->sources = nullptr;
+}
+
+bool AssetPack::open(const char* filename) {
+	int i, j;
+	bool valid;
+	const AssetPackModel* model;
+	const AssetPackSurface* surfaces;
+	const AssetPackMaterial* materials;
+
+	this->close();
+	if (!this->file.open(filename)) return false;
+
+	auto fits = [&](uint64_t offset, uint64_t size) {
+		return offset <= this->file.size && size <= this->file.size - offset;
+	};
+
+	// Reject anything that could read out of the mapping later on
+	this->header = (const AssetPackHeader*)this->file.data;
+	valid = fits(0, sizeof(AssetPackHeader))
+		&& std::memcmp(this->header->magic, ASSET_PACK_MAGIC, sizeof(this->header->magic)) == 0
+		&& this->header->version == ASSET_PACK_VERSION
+		&& this->header->bb_model_index >= -1
+		&& this->header->bb_model_index < (int64_t)this->header->model_count
+		&& fits(this->header->models_offset, sizeof(AssetPackModel) * (uint64_t)this->header->model_count)
+		&& fits(this->header->blocks_offset, sizeof(AssetPackBlock) * (uint64_t)this->header->block_count)
+		&& fits(this->header->sources_offset, sizeof(AssetPackSource) * (uint64_t)this->header->source_count);
+	if (valid) {
+		this->models = (const AssetPackModel*)(this->file.data + this->header->models_offset);
+		this->blocks = (const AssetPackBlock*)(this->file.data + this->header->blocks_offset);
+		this->sources = (const AssetPackSource*)(this->file.data + this->header->sources_offset);
+	}
+	for (i = 0; valid && i < this->header->model_count; i++) {
+		model = &this->models[i];
+		valid = fits(model->path_offset, model->path_size)
+			&& fits(model->name_offset, model->name_size)
+			&& fits(model->verts_offset, sizeof(Vector3) * (uint64_t)model->vert_count)
+			&& fits(model->norms_offset, sizeof(Vector3) * (uint64_t)model->norm_count)
+			&& fits(model->uvs_offset, sizeof(Vector2) * (uint64_t)model->uv_count)
+			&& fits(model->surfaces_offset, sizeof(AssetPackSurface) * (uint64_t)model->surface_count)
+			&& fits(model->materials_offset, sizeof(AssetPackMaterial) * (uint64_t)model->material_count);
+		if (!valid) break;
+		surfaces = (const AssetPackSurface*)(this->file.data + model->surfaces_offset);
+		for (j = 0; valid && j < model->surface_count; j++) {
+			valid = fits(surfaces[j].faces_offset, sizeof(Face) * (uint64_t)surfaces[j].face_count)
+				&& fits(surfaces[j].material_refs_offset, sizeof(AssetPackMaterialRef) * (uint64_t)surfaces[j].material_ref_count);
+		}
+		materials = (const AssetPackMaterial*)(this->file.data + model->materials_offset);
+		for (j = 0; valid && j < model->material_count; j++) {
+			valid = fits(materials[j].name_offset, materials[j].name_size);
+		}
+	}
+	for (i = 0; valid && i < this->header->block_count; i++) {
+		valid = fits(this->blocks[i].key_offset, this->blocks[i].key_size)
+			&& this->blocks[i].model_index >= -1
+			&& this->blocks[i].model_index < (int64_t)this->header->model_count;
+	}
+	for (i = 0; valid && i < this->header->source_count; i++) {
+		valid = fits(this->sources[i].path_offset, this->sources[i].path_size);
+	}
+	if (!valid) {
+		this->close();
+		return false;
+	}
+
+	return true;
+}
+
+void AssetPack::close() {
+	this->file.close();
+	this->header = nullptr;
+	this->models = nullptr;
+	this->blocks = nullptr;
+	this->sources = nullptr;
+	this->loaded.clear();
+}
+
+bool AssetPack::isOpen() const {
+	return this->header != nullptr;
+}
+
+/// Every source file still has the write time and size it was packed with
+bool AssetPack::isCurrent() const {
+	int64_t write_time;
+	uint64_t file_size;
+	std::string path;
+
+	for (int i = 0; i < this->header->source_count; i++) {
+		path = std::string(this->file.data + this->sources[i].path_offset, this->sources[i].path_size);
+		getSourceStamp(path, write_time, file_size);
+		if (write_time != this->sources[i].write_time || file_size != this->sources[i].file_size) {
+			return false;
+		}
+	}
+	return true;
+}
+
+const AssetPackBlock* AssetPack::findBlock(const char* key) const {
+	const AssetPackBlock* found;
+	const AssetPackBlock* blocks_end = this->blocks + this->header->block_count;
+	std::string_view search(key);
+
+	found = std::lower_bound(this->blocks, blocks_end, search,
+		[&](const AssetPackBlock& block, std::string_view value) {
+			return std::string_view(this->file.data + block.key_offset, block.key_size) < value;
+		}
+	);
+	if (found == blocks_end) return nullptr;
+	if (std::string_view(this->file.data + found->key_offset, found->key_size) != search) return nullptr;
+	return found;
+}
+
+void unpackModel(const char* data, const AssetPackModel* model, ObjWavefront& obj) {
+	int i, j;
+	const AssetPackSurface* surfaces;
+	const AssetPackMaterial* materials;
+	const AssetPackMaterialRef* material_refs;
+	std::vector<std::string> material_names;
+
+	obj.name = std::string(data + model->name_offset, model->name_size);
+
+	materials = (const AssetPackMaterial*)(data + model->materials_offset);
+	for (i = 0; i < model->material_count; i++) {
+		Material material;
+		material.name = std::string(data + materials[i].name_offset, materials[i].name_size);
+		material.illum_model = (IllumModel)materials[i].illum_model;
+		material.dissolve = materials[i].dissolve;
+		material.optical_density = materials[i].optical_density;
+		material.spec_exp = materials[i].spec_exp;
+		std::memcpy(&material.ambient, materials[i].ambient, sizeof(materials[i].ambient));
+		std::memcpy(&material.diffuse, materials[i].diffuse, sizeof(materials[i].diffuse));
+		std::memcpy(&material.specular, materials[i].specular, sizeof(materials[i].specular));
+		std::memcpy(&material.emissive, materials[i].emissive, sizeof(materials[i].emissive));
+		material_names.push_back(material.name);
+		obj.materials[material.name] = material;
+	}
+
+	const Vector3* verts = (const Vector3*)(data + model->verts_offset);
+	const Vector3* norms = (const Vector3*)(data + model->norms_offset);
+	const Vector2* uvs = (const Vector2*)(data + model->uvs_offset);
+	obj.geometry->verts.assign(verts, verts + model->vert_count);
+	obj.geometry->norms.assign(norms, norms + model->norm_count);
+	obj.geometry->uvs.assign(uvs, uvs + model->uv_count);
+
+	surfaces = (const AssetPackSurface*)(data + model->surfaces_offset);
+	obj.geometry->surfaces.resize(model->surface_count);
+	for (i = 0; i < model->surface_count; i++) {
+		Surface& surface = obj.geometry->surfaces[i];
+		const Face* faces = (const Face*)(data + surfaces[i].faces_offset);
+		surface.faces.assign(faces, faces + surfaces[i].face_count);
+		// Packed in face order (see packModel)
+		material_refs = (const AssetPackMaterialRef*)(data + surfaces[i].material_refs_offset);
+		for (j = 0; j < surfaces[i].material_ref_count; j++) {
+			if (material_refs[j].material_index < 0) continue;
+			if (material_refs[j].material_index >= material_names.size()) continue;
+			surface.material_ranges.push_back({
+				material_refs[j].face_index,
+				material_names[material_refs[j].material_index]
+			});
+		}
+	}
+}
+
+void AssetPack::readModel(int model_index, ObjWavefront& obj) {
+	if (this->loaded.find(model_index) == this->loaded.end()) {
+		ObjWavefront& unpacked = this->loaded[model_index];
+		unpacked.ul_id = NEXT_UL_ID++;
+		unpackModel(this->file.data, &this->models[model_index], unpacked);
+	}
+	obj = this->loaded[model_index];
+}
+
+std::string getAssetPackFilename(const char* lookup_filename) {
+	std::filesystem::path pack_path(lookup_filename);
+	pack_path.replace_extension(ASSET_PACK_EXT);
+	return pack_path.string();
+}
@@ -0,0 +1,139 @@
+#ifndef ASSETPACK_H
+#define ASSETPACK_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+
+#include "utils.hpp"
+#include "objwavefront.hpp"
+#include "json.hpp"
+using json = nlohmann::json;
+
+/// Bump whenever any of the AssetPack* record layouts change
+const uint32_t ASSET_PACK_VERSION = 2;
+extern const char* ASSET_PACK_MAGIC;
+extern const char* ASSET_PACK_EXT;
+
+// On-disk records, all offsets are from start of file.
+// Arrays are stored exactly as ObjWavefront holds them in memory.
+
+class AssetPackHeader {
+public:
+	char magic[8];
+	uint32_t version;
+	uint32_t model_count;
+	uint32_t block_count;
+	uint32_t source_count;
+	// Model for bounding boxes (lookup shape "CCUBE"), -1 if none
+	int32_t bb_model_index;
+	uint64_t models_offset;
+	uint64_t blocks_offset;
+	uint64_t sources_offset;
+};
+
+/// File the pack was built from (lookup, blockdef, models and their material libraries),
+/// the pack is stale once any of them changes
+class AssetPackSource {
+public:
+	uint64_t path_offset;
+	uint32_t path_size;
+	int32_t reserved;
+	int64_t write_time;
+	uint64_t file_size;
+};
+
+/// Blockdef entry with its lookup already resolved, sorted by key
+class AssetPackBlock {
+public:
+	uint64_t key_offset;
+	uint32_t key_size;
+	// Model from lookup ids, types, or shapes (in that order), -1 if none
+	int32_t model_index;
+	// Shapes are unit models scaled by block size
+	int32_t model_scaled;
+	int32_t has_color;
+	float size[3];
+	float bb_center_offset[3];
+	float bb_dimensions[3];
+	float color[4];
+};
+
+class AssetPackModel {
+public:
+	uint64_t path_offset;
+	uint64_t name_offset;
+	uint64_t verts_offset;
+	uint64_t norms_offset;
+	uint64_t uvs_offset;
+	uint64_t surfaces_offset;
+	uint64_t materials_offset;
+	uint32_t path_size;
+	uint32_t name_size;
+	int32_t vert_count;
+	int32_t norm_count;
+	int32_t uv_count;
+	int32_t surface_count;
+	int32_t material_count;
+	int32_t reserved;
+};
+
+class AssetPackSurface {
+public:
+	uint64_t faces_offset;
+	uint64_t material_refs_offset;
+	int32_t face_count;
+	int32_t material_ref_count;
+};
+
+class AssetPackMaterialRef {
+public:
+	int32_t face_index;
+	int32_t material_index;
+};
+
+class AssetPackMaterial {
+public:
+	uint64_t name_offset;
+	uint32_t name_size;
+	int32_t illum_model;
+	float dissolve;
+	float optical_density;
+	float spec_exp;
+	float ambient[3];
+	float diffuse[3];
+	float specular[3];
+	float emissive[3];
+	int32_t reserved;
+};
+
+/// Precompiled lookup models and blockdef (see hidden option --preload).
+/// The pack is memory mapped, blocks and models are read without any parsing.
+class AssetPack {
+public:
+	MappedFile file;
+	const AssetPackHeader* header;
+	const AssetPackModel* models;
+	const AssetPackBlock* blocks;
+	const AssetPackSource* sources;
+	// Models unpacked so far, shared with every mesh read from them
+	std::unordered_map<int, ObjWavefront> loaded;
+
+	AssetPack();
+
+	static void build(const char* filename, const json& lookup, const json& blockdef, const std::vector<std::string>& source_files);
+
+	bool open(const char* filename);
+	void close();
+	bool isOpen() const;
+	bool isCurrent() const;
+	const AssetPackBlock* findBlock(const char* key) const;
+	void readModel(int model_index, ObjWavefront& obj);
+};
+
+extern AssetPack asset_pack;
+
+std::string getAssetPackFilename(const char* lookup_filename);
+
+#endif // ASSETPACK_H
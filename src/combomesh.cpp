@@ -1,197 +1,206 @@
 #include "combomesh.hpp"
 
+#include <map>
+#include <tuple>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
 #include "utils.hpp"
 #include "exporter.hpp"
 #include "combomesh.hpp"
 #include "objwavefront.hpp"
 #include "workpool.hpp"
 
+Material default_combo_material;
+
 ComboMeshItem::ComboMeshItem() {
-	this->vert_count = 0;
-	this->norm_count = 0;
-	this->uv_count = 0;
 	this->face_count = 0;
+	this->material = nullptr;
 }
 
-bool ComboMeshItem::append(MeshObj& node) {
-	this->vert_index_offs.push_back(this->vert_count);
-	this->norm_index_offs.push_back(this->norm_count);
-	this->uv_index_offs.push_back(this->uv_count);
-	this->meshes.push_back(&node);
-	this->vert_count += node.mesh.vert_count;
-	this->norm_count += node.mesh.norm_count;
-	this->uv_count += node.mesh.uv_count;
-	for (int i = 0; i < node.mesh.surface_count; i++) {
-		this->face_count += node.mesh.surfaces[i].face_count;
-	}
-	
-	return true;
+void ComboMeshItem::append(int mesh_index, int surface_index, int face_start, int face_end) {
+	ComboMeshRange range;
+	range.mesh_index = mesh_index;
+	range.surface_index = surface_index;
+	range.face_start = face_start;
+	range.face_end = face_end;
+	this->ranges.push_back(range);
+	this->face_count += face_end - face_start;
 }
 
 ComboMesh::ComboMesh() {
 	this->surface_count = 0;
+	this->vert_count = 0;
+	this->norm_count = 0;
+	this->uv_count = 0;
 }
 
-// TODO: one day come if with performant way to combine mesh with 2+ materials
 bool ComboMesh::append(MeshObj& node) {
-	std::string color_uid = getEntityColorUid(node);
+	int i, face_start, face_count;
+	int mesh_index = this->meshes.size();
+	const ObjGeometry& geometry = *node.mesh.geometry;
+	Material* material;
+	std::vector<Material*> first_mats;
+	auto add_range = [&](int surface_index, int start, int end) {
+		ComboMeshItem& item = this->cmesh[material->getKey()];
+		if (item.material == nullptr) item.material = material;
+		item.append(mesh_index, surface_index, start, end);
+	};
 
-	if (this->cmesh.find(color_uid) == this->cmesh.end()) {
-		this->cmesh[color_uid].material = node.mesh.getSurfaceMaterials(0)[0];
-	}
-	this->cmesh[color_uid].append(node);
+	this->vert_index_offs.push_back(this->vert_count);
+	this->norm_index_offs.push_back(this->norm_count);
+	this->uv_index_offs.push_back(this->uv_count);
+	this->meshes.push_back(&node);
+	this->vert_count += geometry.verts.size();
+	this->norm_count += geometry.norms.size();
+	this->uv_count += geometry.uvs.size();
 
-	return true;
-}
+	// Faces before any material reference use the mesh's first material
+	first_mats = node.mesh.getSurfaceMaterials(0);
+	material = first_mats.size() > 0 ? first_mats[0] : &default_combo_material;
 
-void globalizeIndecies(const ComboMeshItem& item, MeshObj* mesh, int mesh_index, int vert_off, int norm_off, int uv_off) {
-	int i, j, k;
-	int total_vert_offset = vert_off + item.vert_index_offs[mesh_index];
-	int total_norm_offset = norm_off + item.norm_index_offs[mesh_index];
-	int total_uv_offset = uv_off + item.uv_index_offs[mesh_index];
-	for (i = 0; i < mesh->mesh.surface_count; i++) {
-		for (j = 0; j < mesh->mesh.surfaces[i].face_count; j++) {
-			for (k = 0; k < 3; k++) {
-				mesh->mesh.surfaces[i].faces[j].vert_index[k] += total_vert_offset;
-				mesh->mesh.surfaces[i].faces[j].norm_index[k] += total_norm_offset;
-				mesh->mesh.surfaces[i].faces[j].uv_index[k] += total_uv_offset;
+	// Split surfaces into ranges at each material switch
+	// Like OBJ usemtl, a material carries over into following surfaces
+	for (i = 0; i < geometry.surfaces.size(); i++) {
+		const Surface& surface = geometry.surfaces[i];
+		face_count = surface.faces.size();
+		face_start = 0;
+		for (const MaterialRange& range : surface.material_ranges) {
+			if (range.face_start > face_start) {
+				add_range(i, face_start, range.face_start);
 			}
+			auto found = node.mesh.materials.find(range.name);
+			if (found != node.mesh.materials.end()) material = &found->second;
+			face_start = range.face_start;
+		}
+		if (face_count > face_start) {
+			add_range(i, face_start, face_count);
 		}
 	}
+
+	return true;
 }
 
-template <class T>
-void copyVectorArray(T* dest, T* src, int size, int dest_offset) {
-	for (int i = 0; i < size; i++) {
-		dest[dest_offset + i] = src[i];
-	}
+class ComboMeshCopy {
+public:
+	const Surface* source;
+	Face* faces;
+	int face_start;
+	int face_end;
+	int vert_offset;
+	int norm_offset;
+	int uv_offset;
+};
+
+/// Bulk copy source geometry into its reserved slices of combined
+void copyIntoCombined(ObjGeometry& combined, const ObjGeometry& src, int vert_offset, int norm_offset, int uv_offset) {
+	std::copy(src.verts.begin(), src.verts.end(), combined.verts.begin() + vert_offset);
+	std::copy(src.norms.begin(), src.norms.end(), combined.norms.begin() + norm_offset);
+	std::copy(src.uvs.begin(), src.uvs.end(), combined.uvs.begin() + uv_offset);
 }
 
-void copyFaceArray(Face* dest, Face* src, int size, int dest_offset) {
-	for (int i = 0; i < size; i++) {
-		for (int j = 0; j < 3; j++) {
-			dest[dest_offset + i].vert_index[j] = src[i].vert_index[j];
-			dest[dest_offset + i].norm_index[j] = src[i].norm_index[j];
-			dest[dest_offset + i].uv_index[j] = src[i].uv_index[j];
+/// Copy a face range into its reserved slice, globalizing indices in the same pass
+void copyFacesIntoCombined(const ComboMeshCopy& copy) {
+	int j, k;
+	const Face* src = copy.source->faces.data();
+	Face* dest = copy.faces;
+
+	for (j = copy.face_start; j < copy.face_end; j++) {
+		for (k = 0; k < 3; k++) {
+			dest->vert_index[k] = src[j].vert_index[k] + copy.vert_offset;
+			dest->norm_index[k] = src[j].norm_index[k] + copy.norm_offset;
+			dest->uv_index[k] = src[j].uv_index[k] + copy.uv_offset;
 		}
+		dest++;
 	}
 }
 
 void ComboMesh::commitToMesh(Node& parent) {
-	int i, j, k;
+	int i;
 	const int batch = 100;
-	int total_vert_count = 0;
-	int total_norm_count = 0;
-	int total_uv_count = 0;
-	int total_surface_count = 0;
+	int total_surface_count = this->cmesh.size();
+	int face_index;
+	Material* mat;
+	ComboMeshItem* item;
 	MeshObj* combined = new MeshObj();
 	std::vector<ComboMeshItem*> order;
+	std::vector<ComboMeshCopy> copies;
 
-	for (std::pair<std::string, ComboMeshItem> kv : this->cmesh) {
-		for (i = 0; i < kv.second.meshes.size(); i++) {
-			globalizeIndecies(
-				kv.second,
-				kv.second.meshes[i],
-				i,
-				total_vert_count,
-				total_norm_count,
-				total_uv_count
-			);
-		}
-		order.push_back(&this->cmesh.find(kv.first)->second);
-		total_vert_count += kv.second.vert_count;
-		total_norm_count += kv.second.norm_count;
-		total_uv_count += kv.second.uv_count;
-		total_surface_count += 1;
-	}
-
-	if (total_vert_count > 0) {
-		combined->mesh.vert_count = total_vert_count;
-		combined->mesh.verts = (Vector3*)malloc(sizeof(Vector3) * total_vert_count);
-		if (combined->mesh.verts == NULL) {
-			throw AllocationException("vertices", total_vert_count);
-		}
-	}
-	if (total_norm_count > 0) {
-		combined->mesh.norm_count = total_norm_count;
-		combined->mesh.norms = (Vector3*)malloc(sizeof(Vector3) * total_norm_count);
-		if (combined->mesh.norms == NULL) {
-			throw AllocationException("normals", total_norm_count);
-		}
+	for (auto& kv : this->cmesh) {
+		order.push_back(&kv.second);
 	}
-	if (total_uv_count > 0) {
-		combined->mesh.uv_count = total_uv_count;
-		combined->mesh.uvs = (Vector2*)malloc(sizeof(Vector2) * total_uv_count);
-		if (combined->mesh.uvs == NULL) {
-			throw AllocationException("UVs", total_uv_count);
-		}
+
+	// A lone single material mesh is already combined, hand its geometry over
+	if (this->meshes.size() == 1 && order.size() == 1 && order[0]->ranges.size() == 1
+		&& this->meshes[0]->mesh.geometry->surfaces.size() == 1
+		&& order[0]->face_count == this->meshes[0]->mesh.geometry->surfaces[0].faces.size()
+	) {
+		mat = &material_table.materials[material_table.intern(*order[0]->material)];
+		combined->mesh.geometry = std::move(this->meshes[0]->mesh.geometry);
+		this->meshes[0]->mesh.geometry = std::make_shared<ObjGeometry>();
+		combined->mesh.makeUnique();
+		combined->mesh.geometry->surfaces[0].material_ranges = {{0, mat->name}};
+		combined->mesh.materials[mat->name] = *mat;
+		combined->name = combined->mesh.name = "CominedMesh";
+		parent.addChild(combined);
+		return;
 	}
-	if (total_surface_count > 0) {
-		combined->mesh.surface_count = total_surface_count;
-		combined->mesh.surfaces = (Surface*)malloc(sizeof(Surface) * total_surface_count);
-		if (combined->mesh.surfaces == NULL) {
-			throw AllocationException("surfaces", total_surface_count);
+
+	ObjGeometry& geometry = *combined->mesh.geometry;
+	try {
+		geometry.verts.resize(this->vert_count);
+		geometry.norms.resize(this->norm_count);
+		geometry.uvs.resize(this->uv_count);
+		geometry.surfaces.resize(total_surface_count);
+		for (i = 0; i < total_surface_count; i++) {
+			geometry.surfaces[i].faces.resize(order[i]->face_count);
 		}
+	} catch (std::bad_alloc&) {
+		delete combined;
+		throw AllocationException("combined mesh", this->vert_count);
 	}
 	for (i = 0; i < total_surface_count; i++) {
-		combined->mesh.surfaces[i].face_count = order[i]->face_count;
-		if (order[i]->face_count > 0) {
-			combined->mesh.surfaces[i].faces = (Face*)malloc(sizeof(Face) * order[i]->face_count);
-			if (combined->mesh.surfaces[i].faces == NULL) {
-				throw AllocationException("surface faces", order[i]->face_count);
-			}
-		}
-		combined->mesh.surfaces[i].material_refs = new std::unordered_map<int, std::string>();
-		order[i]->material->name = "mat_" + std::to_string(i);
-		(*combined->mesh.surfaces[i].material_refs)[0] = order[i]->material->name;
-		combined->mesh.materials[order[i]->material->name] = *order[i]->material;
+		mat = &material_table.materials[material_table.intern(*order[i]->material)];
+		geometry.surfaces[i].material_ranges = {{0, mat->name}};
+		combined->mesh.materials[mat->name] = *mat;
 	}
 
-	// Must wait on workpool tasks to finish before pulling results
-	//wp->wait();
-
-	ObjWavefront* obj;
-	Surface* surface;
-	int full_vert_index;
-	int full_norm_index;
-	int full_uv_index;
-	int face_index;
-	int vert_index = 0;
-	int norm_index = 0;
-	int uv_index = 0;
+	// Reserve every face range a disjoint destination slice up front
+	// Note: face indices are 1-based, so offsets apply directly
 	for (i = 0; i < order.size(); i++) {
-		surface = &combined->mesh.surfaces[i];
+		item = order[i];
 		face_index = 0;
-		for (j = 0; j < order[i]->meshes.size(); j++) {
-			obj = &order[i]->meshes[j]->mesh;
-			full_vert_index = vert_index + order[i]->vert_index_offs[j];
-			full_norm_index = norm_index + order[i]->norm_index_offs[j];
-			full_uv_index = uv_index + order[i]->uv_index_offs[j];
-			copyVectorArray<Vector3>(
-				combined->mesh.verts, obj->verts,
-				obj->vert_count, full_vert_index
-			);
-			copyVectorArray<Vector3>(
-				combined->mesh.norms, obj->norms,
-				obj->norm_count, full_norm_index
-			);
-			copyVectorArray<Vector2>(
-				combined->mesh.uvs, obj->uvs,
-				obj->uv_count, full_uv_index
-			);
-			for (k = 0; k < obj->surface_count; k++) {
-				copyFaceArray(
-					surface->faces, obj->surfaces[k].faces,
-					obj->surfaces[k].face_count, face_index
-				);
-				face_index += obj->surfaces[k].face_count;
-			}
+		for (const ComboMeshRange& range : item->ranges) {
+			copies.emplace_back();
+			copies.back().source = &this->meshes[range.mesh_index]->mesh.geometry->surfaces[range.surface_index];
+			copies.back().faces = geometry.surfaces[i].faces.data() + face_index;
+			copies.back().face_start = range.face_start;
+			copies.back().face_end = range.face_end;
+			copies.back().vert_offset = this->vert_index_offs[range.mesh_index];
+			copies.back().norm_offset = this->norm_index_offs[range.mesh_index];
+			copies.back().uv_offset = this->uv_index_offs[range.mesh_index];
+			face_index += range.face_end - range.face_start;
 		}
-		vert_index += order[i]->vert_count;
-		norm_index += order[i]->norm_count;
-		uv_index += order[i]->uv_count;
 	}
 
+	// Slices are disjoint, fill them in parallel
+	parallelFor(this->meshes.size(), batch, [&](int start, int end) {
+		for (int n = start; n < end; n++) {
+			copyIntoCombined(
+				geometry, *this->meshes[n]->mesh.geometry,
+				this->vert_index_offs[n],
+				this->norm_index_offs[n],
+				this->uv_index_offs[n]
+			);
+		}
+	});
+	parallelFor(copies.size(), batch, [&](int start, int end) {
+		for (int n = start; n < end; n++) {
+			copyFacesIntoCombined(copies[n]);
+		}
+	});
+
 	combined->name = combined->mesh.name = "CominedMesh";
 	parent.addChild(combined);
 }
@@ -219,9 +228,9 @@ void buildComboFromSceneChildren(ComboMesh& combo, Node& root) {
 
 void comboEntireScene(Node& root) {
 	int i;
-	ComboMesh* combo = new ComboMesh();
-	buildComboFromSceneChildren(*combo, root);
-	combo->commitToMesh(root);
+	ComboMesh combo;
+	buildComboFromSceneChildren(combo, root);
+	combo.commitToMesh(root);
 	// Cleanup old children (exclude new combo)
 	for (i = root.children.size() - 2; i >= 0; i--) {
 		deleteScene(root.children[i]);
@@ -231,7 +240,7 @@ void comboEntireScene(Node& root) {
 
 void comboSceneMeshes(Node& root) {
 	int i;
-	ComboMesh* combo = new ComboMesh();
+	ComboMesh combo;
 	MeshObj* mnode;
 	std::vector<int> remove_list;
 	for (i = 0; i < root.children.size(); i++) {
@@ -241,12 +250,60 @@ void comboSceneMeshes(Node& root) {
 		}
 		mnode = (MeshObj*)root.children[i];
 		nodeApplyTransforms(mnode, false);
-		combo->append(*mnode);
+		combo.append(*mnode);
 		remove_list.push_back(i);
 	}
-	combo->commitToMesh(root);
+	combo.commitToMesh(root);
 	// Cleanup old children
 	for (i = remove_list.size() - 1; i >= 0; i--) {
+		deleteScene(root.children[remove_list[i]]);
 		root.children.erase(root.children.begin() + remove_list[i]);
 	}
+}
+
+void collectSceneMeshes(Node& root, std::vector<MeshObj*>& meshes) {
+	for (int i = 0; i < root.children.size(); i++) {
+		if (root.children[i]->type == NodeType::Node) {
+			collectSceneMeshes(*root.children[i], meshes);
+			continue;
+		}
+		meshes.push_back((MeshObj*)root.children[i]);
+	}
+}
+
+void comboSceneChunks(Node& root, float chunk_size) {
+	int i;
+	int old_child_count = root.children.size();
+	Vector3 min, max, tile;
+	std::vector<MeshObj*> meshes;
+	// Ordered by tile so chunk nodes come out in a stable order
+	std::map<std::tuple<int, int, int>, ComboMesh> chunks;
+
+	collectSceneMeshes(root, meshes);
+	for (MeshObj* mnode : meshes) {
+		nodeApplyTransforms(mnode, true);
+		if (mnode->mesh.geometry->verts.size() == 0) continue;
+		// Tile by mesh center so each entity lands in exactly one chunk
+		getBounds<Vector3>(mnode->mesh.geometry->verts.data(), mnode->mesh.geometry->verts.size(), min, max);
+		tile = (min + max) * (0.5f / chunk_size);
+		chunks[std::make_tuple(
+			(int)std::floor(tile.x),
+			(int)std::floor(tile.y),
+			(int)std::floor(tile.z)
+		)].append(*mnode);
+	}
+
+	for (auto& kv : chunks) {
+		kv.second.commitToMesh(root);
+		root.children.back()->name = "Chunk ["
+			+ std::to_string(std::get<0>(kv.first)) + ", "
+			+ std::to_string(std::get<1>(kv.first)) + ", "
+			+ std::to_string(std::get<2>(kv.first)) + "]";
+	}
+
+	// Cleanup old children (exclude new chunks)
+	for (i = 0; i < old_child_count; i++) {
+		deleteScene(root.children[i]);
+	}
+	root.children.erase(root.children.begin(), root.children.begin() + old_child_count);
 }
\ No newline at end of file
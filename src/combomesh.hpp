@@ -2,31 +2,40 @@
 #define COMBOMESH_H
 #pragma once
 
-#include <string>
 #include <unordered_map>
 
 #include "scene.hpp"
 
+/// Run of faces sharing one material within a source mesh surface
+class ComboMeshRange {
+public:
+	int mesh_index;
+	int surface_index;
+	int face_start;
+	int face_end;
+};
+
 class ComboMeshItem {
 public:
-	int vert_count;
-	int norm_count;
-	int uv_count;
 	int face_count;
 	Material* material;
-	std::vector<int> vert_index_offs;
-	std::vector<int> norm_index_offs;
-	std::vector<int> uv_index_offs;
-	std::vector<MeshObj*> meshes;
+	std::vector<ComboMeshRange> ranges;
 
 	ComboMeshItem();
-	bool append(MeshObj& node);
+	void append(int mesh_index, int surface_index, int face_start, int face_end);
 };
 
 class ComboMesh {
 public:
 	int surface_count;
-	std::unordered_map<std::string, ComboMeshItem> cmesh;
+	int vert_count;
+	int norm_count;
+	int uv_count;
+	std::vector<int> vert_index_offs;
+	std::vector<int> norm_index_offs;
+	std::vector<int> uv_index_offs;
+	std::vector<MeshObj*> meshes;
+	std::unordered_map<MaterialKey, ComboMeshItem> cmesh;
 
 	ComboMesh();
 	bool append(MeshObj& node);
@@ -35,5 +44,6 @@ public:
 
 void comboEntireScene(Node& root);
 void comboSceneMeshes(Node& root);
+void comboSceneChunks(Node& root, float chunk_size);
 
 #endif // COMBOMESH_H
\ No newline at end of file
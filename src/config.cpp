@@ -67,17 +67,42 @@ const char* PGM_OPTIONS_HELP = ""
 "                    Recommended for large builds: reduces export complexity.\n"
 "                    Unless using Join verticies (-j), individual entity\n"
 "                    geometry will still be retained.\n"
-"                    Note: OBJ exports only supports single objects; a combine\n"
-"                    is always done for OBJ export (grouping in surfaces).\n"
+"        -s <SIZE> : Spatially chunk combined geometry.\n"
+"                    Same as -c, but geometry is also split into world tiles\n"
+"                    of SIZE units per side (e.g. 32.0).\n"
+"                    Each tile becomes its own node with tight bounds,\n"
+"                    allowing viewers to cull and stream large builds.\n"
+"               -n : Instance repeated entities.\n"
+"                    Entities sharing a model and color are written once\n"
+"                    and placed per instance (EXT_mesh_gpu_instancing).\n"
+"                    Greatly reduces size of decoration heavy builds.\n"
+"                    Viewer must support the extension.\n"
+"                    Only applies to TYPEs GLB and GLTF, ignored with -c.\n"
+"               -q : Quantize geometry (KHR_mesh_quantization).\n"
+"                    Positions are stored as 16 bit values scaled to each\n"
+"                    mesh's bounds, normals as 8 bit and indices as 8 or 16\n"
+"                    bit where they fit. About half the size of GLB output.\n"
+"                    Viewer must support the extension.\n"
+"                    Only applies to TYPEs GLB and GLTF.\n"
+"               -z : Compress geometry (EXT_meshopt_compression).\n"
+"                    Buffer data is encoded with the meshoptimizer codecs,\n"
+"                    best combined with -q. Several times smaller downloads.\n"
+"                    Viewer must support the extension.\n"
+"                    Only applies to TYPEs GLB and GLTF.\n"
+"               -f : Flatten group hierarchy.\n"
+"                    Entities are placed directly under the scene instead\n"
+"                    of nested groups. Empty and single entity groups are\n"
+"                    always collapsed.\n"
+"                    Only applies to TYPEs GLB and GLTF.\n"
 "               -m : Merge into single geometry.\n"
 "                    Same as using '-rja'.\n"
 "                    Warning: materials will switch to default.\n"
 "               -r : Remove internal faces.\n"
-"                    Only within same material (unless TYPE OBJ or using -a).\n"
+"                    Only within same material (unless using -a).\n"
 "                    Any faces adjacent and opposite another face are removed.\n"
 "                    This includes their opposing neighbor's face.\n"
 "               -j : Join verticies.\n"
-"                    Only within same material (unless TYPE OBJ or using -a).\n"
+"                    Only within same material (unless using -a).\n"
 "                    Any vertices sharing a location with another, or within\n"
 "                    a very small distance, will be reduced to a single vertex.\n"
 "                    This efectively \"hardens\" or \"joins\" Yland entities\n"
@@ -97,10 +122,10 @@ const char* PGM_OPTIONS_HELP = ""
 "}\n";
 /*
 Hidden Options (for post-build):
---preload <file> : Run YlandStandard::preload_lookups(<file>).
+--preload <file> : Run YlandStandard::compileLookups(<file>).
 				   Iterates through refs, loading *.obj files.
-				   Substitues the lookup with loaded objects.
-				   Serializes the result into a binary file
+				   Serializes loaded models, lookup, and blockdef
+				   into a binary asset pack (<file> as *.pack)
 				   to be loaded by enduser at runtime.
 */
 
@@ -130,6 +155,7 @@ Config getConfigFromArgs(int argc, char** argv) {
 	bool get_output_filename = false;
 	bool get_export_type = false;
 	bool get_bb_transparency = false;
+	bool get_chunk_size = false;
 	bool missing_arg = false;
 	char missing_arg_name[25];
 	char missing_arg_expects[100];
@@ -146,6 +172,12 @@ Config getConfigFromArgs(int argc, char** argv) {
 	config.combine = false;
 	config.draw_bb = false;
 	config.draw_bb_transparency = 0.5f;
+	config.chunk = false;
+	config.instancing = false;
+	config.quantize = false;
+	config.compress = false;
+	config.flatten = false;
+	config.chunk_size = 32.0f;
 
 	// Defaults (config.json)
 	config.ylands_install_dir = "";
@@ -178,6 +210,15 @@ Config getConfigFromArgs(int argc, char** argv) {
 			} catch (std::exception) {
 				break;
 			}
+		} else if (get_chunk_size) {
+			try {
+				config.chunk_size = std::stof(argv[i]);
+				if (config.chunk_size > 0.0f) {
+					get_chunk_size = false;
+				} else break;
+			} catch (std::exception) {
+				break;
+			}
 		} else if (get_export_type) {
 			if (std::strcmp(argv[i], "GLB") == 0 || std::strcmp(argv[i], "glb") == 0) {
 				config.export_type = ExportType::GLB;
@@ -186,7 +227,6 @@ Config getConfigFromArgs(int argc, char** argv) {
 				config.export_type = ExportType::GLTF;
 				get_export_type = false;
 			} else if (std::strcmp(argv[i], "OBJ") == 0 || std::strcmp(argv[i], "obj") == 0) {
-				config.combine = true;
 				config.export_type = ExportType::OBJ;
 				get_export_type = false;
 			} else if (std::strcmp(argv[i], "JSON") == 0 || std::strcmp(argv[i], "json") == 0) {
@@ -228,6 +268,18 @@ Config getConfigFromArgs(int argc, char** argv) {
 			config.apply_all = true;
 		} else if (std::strcmp(argv[i], "-c") == 0) {
 			config.combine = true;
+		} else if (std::strcmp(argv[i], "-n") == 0) {
+			config.instancing = true;
+		} else if (std::strcmp(argv[i], "-q") == 0) {
+			config.quantize = true;
+		} else if (std::strcmp(argv[i], "-z") == 0) {
+			config.compress = true;
+		} else if (std::strcmp(argv[i], "-f") == 0) {
+			config.flatten = true;
+		} else if (std::strcmp(argv[i], "-s") == 0) {
+			config.combine = true;
+			config.chunk = true;
+			get_chunk_size = true;
 		} else if (std::strcmp(argv[i], "-u") == 0) {
 			config.draw_bb = true;
 			get_bb_transparency = true;
@@ -241,7 +293,7 @@ Config getConfigFromArgs(int argc, char** argv) {
 	// Check if secondary args missing
 	missing_arg = get_preload_filename || get_input_filename ||
 				  get_output_filename || get_export_type ||
-				  get_bb_transparency;
+				  get_bb_transparency || get_chunk_size;
 	if (get_preload_filename) {
 		std::strcpy(missing_arg_name, "--preload");
 		std::strcpy(missing_arg_expects, "a filename");
@@ -257,6 +309,9 @@ Config getConfigFromArgs(int argc, char** argv) {
 	} else if (get_bb_transparency) {
 		std::strcpy(missing_arg_name, "-u");
 		std::strcpy(missing_arg_expects, "a decimal value (between 0.0 and 1.0)");
+	} else if (get_chunk_size) {
+		std::strcpy(missing_arg_name, "-s");
+		std::strcpy(missing_arg_expects, "a decimal value (greater than 0.0)");
 	}
 	if (missing_arg) {
 		std::cerr << "Arguement missing: \"" << missing_arg_name
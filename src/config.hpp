@@ -28,8 +28,14 @@ public:
 	bool preload;
 	bool has_input;
 	bool draw_bb;
+	bool chunk;
+	bool instancing;
+	bool quantize;
+	bool compress;
+	bool flatten;
 	ExportType export_type;
 	float draw_bb_transparency;
+	float chunk_size;
 	std::string preload_filename;
 	std::string input_filename;
 	std::string output_filename;
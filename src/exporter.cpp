@@ -2,6 +2,7 @@
 
 #include <iostream>
 #include <fstream>
+#include <iomanip>
 
 #include "utils.hpp"
 #include "config.hpp"
@@ -11,6 +12,7 @@
 #include "reducer.hpp"
 #include "objwavefront.hpp"
 #include "gltf.hpp"
+#include "ylands.hpp"
 #include "workpool.hpp"
 
 // IMPORTANT: When in debug, make sure no_threads is true
@@ -19,12 +21,26 @@ Workpool* wp = NULL;//new Workpool(std::thread::hardware_concurrency() * 50, fal
 void combineMeshFromScene(const Config& config, Node* scene);
 void removeInternalFacesInScene(Node* scene);
 void vertexJoinMeshInScene(Node* scene);
+void collapseHierarchyInScene(const Config& config, Node* scene);
 
 int extractAndExport(Config& config) {
 	Node* scene;
 	ComboMesh combo;
+	GLTFOptions options;
 	json data;
 
+	// Post-build: compile lookup models into an asset pack
+	if (config.preload) {
+		try {
+			YlandStandard::compileLookups(config.preload_filename.c_str());
+		} catch (CustomException& e) {
+			std::cerr << "Error preloading \"" << config.preload_filename
+					  << "\": " << e.what() << std::endl;
+			return 1;
+		}
+		return 0;
+	}
+
 	// Load Ylands data
 	if (!config.has_input) {
 		// From Ylands directly
@@ -135,9 +151,15 @@ int extractAndExport(Config& config) {
 	}
 
 	// GLTF export
+	if (config.export_type == ExportType::GLTF || config.export_type == ExportType::GLB) {
+		collapseHierarchyInScene(config, scene);
+	}
+	options.instancing = config.instancing;
+	options.quantize = config.quantize;
+	options.compress = config.compress;
 	if (config.export_type == ExportType::GLTF) {
 		try {
-			exportAsGLTF(config.output_filename.c_str(), *scene, false);
+			exportAsGLTF(config.output_filename.c_str(), *scene, false, options);
 		} catch (CustomException& e) {
 			std::cerr << "Error exporting GLTF file \""
 					  << config.output_filename << "\": "
@@ -149,7 +171,7 @@ int extractAndExport(Config& config) {
 	// GLB export
 	if (config.export_type == ExportType::GLB) {
 		try {
-			exportAsGLTF(config.output_filename.c_str(), *scene, true);
+			exportAsGLTF(config.output_filename.c_str(), *scene, true, options);
 		} catch (CustomException& e) {
 			std::cerr << "Error exporting GLB file \""
 					  << config.output_filename << "\": "
@@ -175,10 +197,11 @@ void exportAsJson(const char* filename, const json& data, bool pprint) {
 	if (!f.is_open()) {
 		throw SaveException("Failed to open file");
 	}
+	// Serialize straight into the file rather than through a full string
 	if (pprint) {
-		f << data.dump(4);
+		f << std::setw(4) << data;
 	} else {
-		f << data.dump();
+		f << data;
 	}
 	f.close();
 	std::cout << "Export complete" << std::endl;
@@ -186,26 +209,40 @@ void exportAsJson(const char* filename, const json& data, bool pprint) {
 	std::cout << std::endl;
 }
 
+/// Write each mesh as its own object, freeing its geometry once written
+void writeObjFromSceneChildren(ObjStreamWriter& writer, Node& root) {
+	MeshObj* mnode;
+	for (int i = 0; i < root.children.size(); i++) {
+		if (root.children[i]->type == NodeType::Node) {
+			writeObjFromSceneChildren(writer, *root.children[i]);
+			continue;
+		}
+		mnode = (MeshObj*)root.children[i];
+		nodeApplyTransforms(mnode, true);
+		writer.write(mnode->mesh, mnode->name, root.parent != NULL ? root.name : "");
+		mnode->mesh.clear();
+	}
+}
+
 void exportAsObj(const char* filename, Node& scene) {
 	double s;
+	ObjStreamWriter writer;
 	char filename_ext[200] = "";
 
 	std::strcat(filename_ext, filename);
 	std::strcat(filename_ext, ".obj");
 
-	if (scene.children.size() > 1 || scene.children[0]->type != NodeType::MeshObj) {
-		throw GeneralException("OBJ export expects fully combined scene");
-	}
-
 	s = timerStart();
 	std::cout << "Exporting [OBJ] file \"" << filename_ext << "\"..." << std::endl;
-	((MeshObj*)scene.children[0])->mesh.save(filename_ext);
+	writer.open(filename_ext);
+	writeObjFromSceneChildren(writer, scene);
+	writer.close();
 	std::cout << "Export complete" << std::endl;
 	timerStopMsAndPrint(s);
 	std::cout << std::endl;
 }
 
-void exportAsGLTF(const char* filename, Node& scene, bool single_glb) {
+void exportAsGLTF(const char* filename, Node& scene, bool single_glb, const GLTFOptions& options) {
 	double s;
 	GLTF* gltf;
 	char filename_ext[200] = "";
@@ -225,7 +262,7 @@ void exportAsGLTF(const char* filename, Node& scene, bool single_glb) {
 		std::cout << "GLTF";
 	}
 	std::cout << "] file \"" << filename_ext << "\"..." << std::endl;
-	gltf = createGLTFFromScene(scene);
+	gltf = createGLTFFromScene(scene, options);
 	gltf->save(filename_ext, single_glb);
 	std::cout << "Export complete" << std::endl;
 	timerStopMsAndPrint(s);
@@ -234,8 +271,8 @@ void exportAsGLTF(const char* filename, Node& scene, bool single_glb) {
 void combineMeshFromScene(const Config& config, Node* scene) {
 	double s = timerStart();
 	std::cout << "Applying config [COMBINE]..." << std::endl;
-	if (config.export_type == ExportType::OBJ) {
-		comboEntireScene(*scene);
+	if (config.chunk) {
+		comboSceneChunks(*scene, config.chunk_size);
 	} else {
 		comboSceneMeshes(*scene);
 	}
@@ -244,6 +281,16 @@ void combineMeshFromScene(const Config& config, Node* scene) {
 	std::cout << std::endl;\
 }
 
+void collapseHierarchyInScene(const Config& config, Node* scene) {
+	int count;
+	double s = timerStart();
+	std::cout << "Applying config [" << (config.flatten ? "Flatten" : "Collapse") << " Hierarchy]..." << std::endl;
+	count = collapseSceneHierarchy(*scene, config.flatten);
+	std::cout << "Applied (removed " << count << " groups)" << std::endl;
+	timerStopMsAndPrint(s);
+	std::cout << std::endl;
+}
+
 void removeInternalFacesInScene(Node* scene) {
 	int count;
 	double s = timerStart();
@@ -8,12 +8,13 @@ using json = nlohmann::json;
 class Config;
 class Node;
 class Workpool;
+class GLTFOptions;
 
 extern Workpool* wp;
 
 int extractAndExport(Config& config);
 void exportAsJson(const char* filename, const json& data, bool pprint);
 void exportAsObj(const char* filename, Node& scene);
-void exportAsGLTF(const char* filename, Node& scene, bool single_glb);
+void exportAsGLTF(const char* filename, Node& scene, bool single_glb, const GLTFOptions& options);
 
 #endif // EXPORTER_H
\ No newline at end of file
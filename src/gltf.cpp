@@ -1,14 +1,20 @@
 #include "gltf.hpp"
 
+#include <iostream>
 #include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <cmath>
 #include <unordered_map>
+#include <unordered_set>
 
 #include "utils.hpp"
 #include "config.hpp"
 #include "space.hpp"
 #include "scene.hpp"
-#include "json.hpp"
-using json = nlohmann::json;
+#include "workpool.hpp"
+#include "meshopt.hpp"
+#include "jsonwriter.hpp"
 
 inline int GLTFBVTargetToInt(GLTFBVTarget target) {
 	return 34962 + (int)target;
@@ -30,31 +36,42 @@ std::string GLTFAccTypeToString[] = {
 	"VEC4"
 };
 
-void GLTFCompTypePushBack(const GLTFCompType type, json& arr, const uint32_t& value) {
+void GLTFCompTypeWrite(const GLTFCompType type, JsonWriter& writer, const uint32_t& value) {
 	switch (type) {
 		case GLTFCompType::BYTE:
-			arr.push_back((int8_t)value);
+			writer.value((int)(int8_t)value);
 			break;
 		case GLTFCompType::UNSIGNED_BYTE:
-			arr.push_back((uint8_t)value);
+			writer.value((int)(uint8_t)value);
 			break;
 		case GLTFCompType::SHORT:
-			arr.push_back((int16_t)value);
+			writer.value((int)(int16_t)value);
 			break;
 		case GLTFCompType::UNSIGNED_SHORT:
-			arr.push_back((uint16_t)value);
+			writer.value((int)(uint16_t)value);
 			break;
 		case GLTFCompType::UNSIGNED_INT:
-			arr.push_back(value);
+			writer.value(value);
 			break;
 		case GLTFCompType::FLOAT:
 			float fval;
 			std::memcpy(&fval, &value, sizeof(float));
-			arr.push_back(fval);
+			writer.value(fval);
 			break;
 	}
 }
 
+void writeFallbackBuffer(JsonWriter& writer, int byte_length) {
+	writer.beginObject();
+	writer.key("byteLength").value(byte_length);
+	writer.key("extensions").beginObject();
+	writer.key("EXT_meshopt_compression").beginObject();
+	writer.key("fallback").value(true);
+	writer.endObject();
+	writer.endObject();
+	writer.endObject();
+}
+
 int GLTFCompTypeToInt[] = {
 	5120,
 	5121,
@@ -64,6 +81,21 @@ int GLTFCompTypeToInt[] = {
 	5126
 };
 
+int GLTFCompTypeToSize[] = {
+	1,
+	1,
+	2,
+	2,
+	4,
+	4
+};
+
+std::string GLTFMeshoptModeToString[] = {
+	"",  // Don't use
+	"ATTRIBUTES",
+	"TRIANGLES"
+};
+
 std::string GLTFTopoTypesToString[] = {
 	"POINTS",
 	"LINE_STRIPS",
@@ -74,13 +106,65 @@ std::string GLTFTopoTypesToString[] = {
 	"TIRANGLE_FANS"
 };
 
-int GLBuffer::addData(std::byte* new_data, int size) {
-	int i;
-	int index = this->data.size();
-	for (i = 0; i < size; i++) {
-		this->data.push_back(new_data[i]);
+// Most block bytes generated ahead of writing
+const int GLB_WRITE_WINDOW = 32 << 20;
+// GLB header and chunk lengths are 32 bit
+const uint64_t GLB_MAX_BYTES = UINT32_MAX;
+// Blocks go to a new buffer once the current one would grow past this (GLTF writes one file each)
+const int GLTF_BUFFER_SPLIT_BYTES = 256 << 20;
+
+GLBuffer::GLBuffer() {
+	this->byte_length = 0;
+	this->fallback = false;
+}
+
+/// Reserve size bytes (4 byte aligned) written later by write, returns the byte offset
+int GLBuffer::addBlock(int size, const std::function<void(std::byte* dest)>& write) {
+	GLBufferBlock block;
+	block.byte_offset = (this->byte_length + 3) & ~3;
+	block.byte_length = size;
+	block.write = write;
+	this->byte_length = block.byte_offset + size;
+	this->blocks.push_back(block);
+	return block.byte_offset;
+}
+
+/// Stream blocks in order through a bounded window, the whole buffer is never held in memory
+void GLBuffer::write(std::ostream& f) const {
+	int start, end;
+	int written = 0;
+	int window_end;
+	std::vector<std::byte> window;
+
+	for (start = 0; start < this->blocks.size(); start = end) {
+		// At least one block, more while they fit in the window
+		end = start + 1;
+		while (end < this->blocks.size()
+			&& this->blocks[end].byte_offset + this->blocks[end].byte_length - written <= GLB_WRITE_WINDOW
+		) {
+			end += 1;
+		}
+		window_end = this->blocks[end - 1].byte_offset + this->blocks[end - 1].byte_length;
+
+		// Zeroed so alignment padding between blocks is written as 0x00
+		window.assign(window_end - written, std::byte(0));
+		parallelFor(end - start, 64, [&](int first, int last) {
+			for (int i = start + first; i < start + last; i++) {
+				this->blocks[i].write(window.data() + this->blocks[i].byte_offset - written);
+			}
+		});
+		f.write(reinterpret_cast<const char*>(window.data()), window.size());
+		written = window_end;
 	}
-	return index;
+}
+
+GLMeshopt::GLMeshopt() {
+	this->mode = GLTFMeshoptMode::NONE;
+	this->buffer_index = -1;
+	this->byte_offset = 0;
+	this->byte_length = 0;
+	this->byte_stride = 0;
+	this->count = 0;
 }
 
 GLBufferView::GLBufferView() {
@@ -104,6 +188,7 @@ GLAccessor::GLAccessor() {
 	this->count = 0;
 	this->type = GLTFAccType::SCALAR;
 	this->component_type = GLTFCompType::FLOAT;
+	this->normalized = false;
 	this->min = nullptr;
 	this->max = nullptr;
 }
@@ -158,12 +243,26 @@ GLPrimitive::GLPrimitive(int indices_idx, int mat_idx, GLTFTopoTypes mode) {
 	this->mode = mode;
 }
 
+GLMesh::GLMesh() {
+	this->dequant_translation = nullptr;
+	this->dequant_scale = nullptr;
+}
+
+GLMesh::~GLMesh() {
+	if (this->dequant_translation != nullptr) delete this->dequant_translation;
+	if (this->dequant_scale != nullptr) delete this->dequant_scale;
+}
+
 GLNode::GLNode() {
 	this->translation = nullptr;
 	this->scale = nullptr;
 	this->rotation = nullptr;
+	this->owns_transform = false;
 	this->name[0] = '\0';
 	this->mesh_index = -1;
+	this->instance_translation_index = -1;
+	this->instance_rotation_index = -1;
+	this->instance_scale_index = -1;
 }
 
 GLNode::GLNode(const char* name, Vector3* position, Vector3* scale, Quaternion* rotation) : GLNode() {
@@ -173,6 +272,13 @@ GLNode::GLNode(const char* name, Vector3* position, Vector3* scale, Quaternion*
 	std::strcpy(this->name, name);
 }
 
+GLNode::~GLNode() {
+	if (this->owns_transform) {
+		if (this->translation != nullptr) delete this->translation;
+		if (this->scale != nullptr) delete this->scale;
+	}
+}
+
 void GLNode::addChild(int node_idx) {
 	this->child_indicies.push_back(node_idx);
 }
@@ -181,10 +287,32 @@ void GLScene::addNode(int node_idx) {
 	this->node_indicies.push_back(node_idx);
 }
 
+GLTFOptions::GLTFOptions() {
+	this->instancing = false;
+	this->quantize = false;
+	this->compress = false;
+}
+
 GLTF::GLTF() {
 	this->default_scene_index = -1;
 }
 
+/// Reserve a block in the last buffer, or a new one when it would pass GLTF_BUFFER_SPLIT_BYTES.
+/// Sets buffer_index and returns the block's byte offset within that buffer.
+int GLTF::addBlock(int64_t size, const std::function<void(std::byte* dest)>& write, int& buffer_index) {
+	GLBuffer* buffer = this->buffers.back();
+	// Offsets and lengths are ints, a single block can't pass that
+	if (size > INT32_MAX - 3) {
+		throw AllocationException("glTF buffer block (MB)", size >> 20);
+	}
+	if (buffer->byte_length > 0 && ((int64_t)buffer->byte_length + 3 + size) > GLTF_BUFFER_SPLIT_BYTES) {
+		buffer = new GLBuffer();
+		this->buffers.push_back(buffer);
+	}
+	buffer_index = this->buffers.size() - 1;
+	return buffer->addBlock(size, write);
+}
+
 GLTF::~GLTF() {
 	int i;
 	for (i = 0; i < this->scenes.size(); i++) {
@@ -217,327 +345,625 @@ GLTF::~GLTF() {
 	this->buffers.clear();
 }
 
+/// Save a GLB too large for its 32 bit lengths as GLTF next to it, with the same name
+void GLTF::saveAsGLTFFallback(const char* filename) {
+	std::filesystem::path gltf_path(filename);
+	gltf_path.replace_extension(".gltf");
+	std::cout << "Warning: Export exceeds the 4GB GLB limit, saving as GLTF \""
+			  << gltf_path.string() << "\" instead" << std::endl;
+	this->save(gltf_path.string().c_str(), false);
+}
+
 void GLTF::save(const char* filename, bool single_glb) {
 	int i, j, limit;
-	int buffer_shift;
+	int glb_fallback_count = 0;
+	int saved_buffer_count = 0;
+	uint64_t glb_bin_bytes = 0;
 	std::string base_dir;
 	std::string bin_filename;
-	json data;
-	json* subdata;
+	// Buffer as saved and offset within it, for each buffer
+	std::vector<int> buffer_index(this->buffers.size());
+	std::vector<uint64_t> buffer_shift(this->buffers.size(), 0);
+	// GLTF buffers written to .bin files once the JSON is done
+	std::vector<int> bin_buffers;
 
 	// Get base dir if to setup multifile saving later
 	if (!single_glb) {
 		base_dir = f_base_dir(filename);
 	}
 
-	data["asset"] = {
-		{"version", "2.0"},
-		{"generator", std::string(PGM_NAME_READABLE) + " v" + PGM_VERSION + " " + PGM_REF_LINK}
-	};
+	// GLB writes data buffers back to back (4 byte aligned) as the single BIN chunk buffer,
+	// fallback buffers hold no data and follow it
+	for (i = 0; i < this->buffers.size(); i++) {
+		if (!single_glb) {
+			buffer_index[i] = i;
+			if (this->buffers[i]->byte_length > 0) saved_buffer_count += 1;
+		} else if (this->buffers[i]->fallback) {
+			glb_fallback_count += 1;
+			buffer_index[i] = glb_fallback_count;
+		} else {
+			buffer_index[i] = 0;
+			buffer_shift[i] = (glb_bin_bytes + 3) & ~3;
+			glb_bin_bytes = buffer_shift[i] + this->buffers[i]->byte_length;
+		}
+	}
+	if (single_glb) saved_buffer_count = glb_fallback_count + (glb_bin_bytes > 0 ? 1 : 0);
+
+	// GLB lengths are 32 bit, too large a BIN chunk is saved as GLTF instead
+	if (single_glb && glb_bin_bytes > GLB_MAX_BYTES) {
+		this->saveAsGLTFFallback(filename);
+		return;
+	}
+
+	std::ofstream f(filename, single_glb ? std::ios::binary : std::ios::out);
+	if (!f.is_open()) {
+		throw SaveException("Cannot open file for writing \"" + std::string(filename) + "\"");
+	}
+	// GLB header and JSON chunk header, filled in once the JSON length is known
+	if (single_glb) {
+		f.write("\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0", 20);
+	}
+
+	// JSON is streamed into the file as it is produced
+	JsonWriter writer(f);
+	writer.beginObject();
+
+	writer.key("asset").beginObject();
+	writer.key("version").value("2.0");
+	writer.key("generator").value(std::string(PGM_NAME_READABLE) + " v" + PGM_VERSION + " " + PGM_REF_LINK);
+	writer.endObject();
+
+	if (this->extensions_used.size() > 0) {
+		writer.key("extensionsUsed").values(this->extensions_used);
+	}
+	if (this->extensions_required.size() > 0) {
+		writer.key("extensionsRequired").values(this->extensions_required);
+	}
 
 	if (this->default_scene_index >= 0) {
-		data["scene"] = this->default_scene_index;
+		writer.key("scene").value(this->default_scene_index);
 	}
 
 	// Scenes
-	if (this->scenes.size() > 0) data["scenes"] = json::array();
+	if (this->scenes.size() > 0) writer.key("scenes").beginArray();
 	for (i = 0; i < this->scenes.size(); i++) {
-		subdata = new json({});
+		writer.beginObject();
 		// Leave empty if scene has no nodes
 		if (this->scenes[i]->node_indicies.size() > 0) {
-			(*subdata)["nodes"] = this->scenes[i]->node_indicies;
+			writer.key("nodes").values(this->scenes[i]->node_indicies);
 		}
-		data["scenes"].push_back(*subdata);
+		writer.endObject();
 	}
+	if (this->scenes.size() > 0) writer.endArray();
 
 	// Nodes
-	if (this->nodes.size() > 0) data["nodes"] = json::array();
+	if (this->nodes.size() > 0) writer.key("nodes").beginArray();
 	for (i = 0; i < this->nodes.size(); i++) {
-		subdata = new json({});
-		(*subdata)["name"] = this->nodes[i]->name;
-		(*subdata)["translation"] = {
-			this->nodes[i]->translation->x,
-			this->nodes[i]->translation->y,
-			this->nodes[i]->translation->z
-		};
-		(*subdata)["rotation"] = {
-			this->nodes[i]->rotation->x,
-			this->nodes[i]->rotation->y,
-			this->nodes[i]->rotation->z,
-			this->nodes[i]->rotation->w
-		};
-		(*subdata)["scale"] = {
-			this->nodes[i]->scale->x,
-			this->nodes[i]->scale->y,
-			this->nodes[i]->scale->z
-		};
-		if (this->nodes[i]->child_indicies.size() > 0) {
-			(*subdata)["children"] = this->nodes[i]->child_indicies;
-		}
-		if (this->nodes[i]->mesh_index >= 0) {
-			(*subdata)["mesh"] = this->nodes[i]->mesh_index;
-		}
-		data["nodes"].push_back(*subdata);
+		const GLNode& node = *this->nodes[i];
+		writer.beginObject();
+		writer.key("name").value(node.name);
+		if (node.translation != nullptr) {
+			writer.key("translation").values(&node.translation->x, 3);
+		}
+		if (node.rotation != nullptr) {
+			writer.key("rotation").beginArray();
+			writer.value(node.rotation->x);
+			writer.value(node.rotation->y);
+			writer.value(node.rotation->z);
+			writer.value(node.rotation->w);
+			writer.endArray();
+		}
+		if (node.scale != nullptr) {
+			writer.key("scale").values(&node.scale->x, 3);
+		}
+		if (node.child_indicies.size() > 0) {
+			writer.key("children").values(node.child_indicies);
+		}
+		if (node.mesh_index >= 0) {
+			writer.key("mesh").value(node.mesh_index);
+		}
+		if (node.instance_translation_index >= 0) {
+			writer.key("extensions").beginObject();
+			writer.key("EXT_mesh_gpu_instancing").beginObject();
+			writer.key("attributes").beginObject();
+			writer.key("TRANSLATION").value(node.instance_translation_index);
+			writer.key("ROTATION").value(node.instance_rotation_index);
+			writer.key("SCALE").value(node.instance_scale_index);
+			writer.endObject();
+			writer.endObject();
+			writer.endObject();
+		}
+		writer.endObject();
 	}
+	if (this->nodes.size() > 0) writer.endArray();
 
 	// Meshes
-	if (this->meshes.size() > 0) data["meshes"] = json::array();
+	if (this->meshes.size() > 0) writer.key("meshes").beginArray();
 	for (i = 0; i < this->meshes.size(); i++) {
-		if (this->meshes[i]->primitives.size() > 0) data["meshes"].push_back({{"primitives", json::array()}});
+		if (this->meshes[i]->primitives.size() == 0) continue;
+		writer.beginObject();
+		writer.key("primitives").beginArray();
 		for (j = 0; j < this->meshes[i]->primitives.size(); j++) {
-			subdata = new json({});
-			(*subdata)["mode"] = (int)this->meshes[i]->primitives[j]->mode;
-			if (this->meshes[i]->primitives[j]->material_index >= 0) {
-				(*subdata)["material"] = this->meshes[i]->primitives[j]->material_index;
+			const GLPrimitive& prim = *this->meshes[i]->primitives[j];
+			writer.beginObject();
+			writer.key("mode").value((int)prim.mode);
+			if (prim.material_index >= 0) {
+				writer.key("material").value(prim.material_index);
 			}
-			if (this->meshes[i]->primitives[j]->indices >= 0) {
-				(*subdata)["indices"] = this->meshes[i]->primitives[j]->indices;
+			if (prim.indices >= 0) {
+				writer.key("indices").value(prim.indices);
 			}
-			(*subdata)["attributes"] = json::object();
-			if (this->meshes[i]->primitives[j]->attributes.position_index >= 0) {
-				(*subdata)["attributes"]["POSITION"] = this->meshes[i]->primitives[j]->attributes.position_index;
+			writer.key("attributes").beginObject();
+			if (prim.attributes.position_index >= 0) {
+				writer.key("POSITION").value(prim.attributes.position_index);
 			}
-			if (this->meshes[i]->primitives[j]->attributes.normal_index >= 0) {
-				(*subdata)["attributes"]["NORMAL"] = this->meshes[i]->primitives[j]->attributes.normal_index;
+			if (prim.attributes.normal_index >= 0) {
+				writer.key("NORMAL").value(prim.attributes.normal_index);
 			}
-			if (this->meshes[i]->primitives[j]->attributes.texcoord_0_index >= 0) {
-				(*subdata)["attributes"]["TEXCOORD_0"] = this->meshes[i]->primitives[j]->attributes.texcoord_0_index;
+			if (prim.attributes.texcoord_0_index >= 0) {
+				writer.key("TEXCOORD_0").value(prim.attributes.texcoord_0_index);
 			}
-			data["meshes"][data["meshes"].size()-1]["primitives"].push_back(*subdata);
+			writer.endObject();
+			writer.endObject();
 		}
+		writer.endArray();
+		writer.endObject();
 	}
+	if (this->meshes.size() > 0) writer.endArray();
 
 	// Materials
-	if (this->materials.size() > 0) data["materials"] = json::array();
+	if (this->materials.size() > 0) writer.key("materials").beginArray();
 	for (i = 0; i < this->materials.size(); i++) {
-		subdata = new json({});
-		if (this->materials[i]->alpha_mode != GLTFAlphaMode::NONE) {
-			(*subdata)["alphaMode"] = GLTFAlphaModeToString[(int)this->materials[i]->alpha_mode];
+		const GLMaterial& material = *this->materials[i];
+		writer.beginObject();
+		if (material.alpha_mode != GLTFAlphaMode::NONE) {
+			writer.key("alphaMode").value(GLTFAlphaModeToString[(int)material.alpha_mode]);
 		}
-		(*subdata)["pbrMetallicRoughness"] = json::object();
-		(*subdata)["pbrMetallicRoughness"]["roughnessFactor"] = this->materials[i]->roughness;
-		(*subdata)["pbrMetallicRoughness"]["metallicFactor"] = this->materials[i]->matalic;
-		(*subdata)["pbrMetallicRoughness"]["baseColorFactor"] = this->materials[i]->base_color;
-		if (this->materials[i]->emissive[0] > 0.0f
-			&& this->materials[i]->emissive[1] > 0.0f
-			&& this->materials[i]->emissive[2] > 0.0f) {
-			(*subdata)["emissiveFactor"] = this->materials[i]->emissive;
+		writer.key("pbrMetallicRoughness").beginObject();
+		writer.key("roughnessFactor").value(material.roughness);
+		writer.key("metallicFactor").value(material.matalic);
+		writer.key("baseColorFactor").values(material.base_color, 4);
+		writer.endObject();
+		if (material.emissive[0] > 0.0f
+			&& material.emissive[1] > 0.0f
+			&& material.emissive[2] > 0.0f) {
+			writer.key("emissiveFactor").values(material.emissive, 3);
 		}
-		data["materials"].push_back(*subdata);
+		writer.endObject();
 	}
+	if (this->materials.size() > 0) writer.endArray();
 
 	// Accessors
-	if (this->accessors.size() > 0) data["accessors"] = json::array();
+	if (this->accessors.size() > 0) writer.key("accessors").beginArray();
 	for (i = 0; i < this->accessors.size(); i++) {
-		subdata = new json({});
-		(*subdata)["bufferView"] = this->accessors[i]->bufferview_index;
-		(*subdata)["byteOffset"] = this->accessors[i]->byte_offset;
-		(*subdata)["type"] = GLTFAccTypeToString[(int)this->accessors[i]->type];
-		(*subdata)["componentType"] = GLTFCompTypeToInt[(int)this->accessors[i]->component_type];
-		(*subdata)["count"] = this->accessors[i]->count;
-		limit = GLTFAccTypeToInt(this->accessors[i]->type);
-
-		if (this->accessors[i]->max != nullptr) {
-			(*subdata)["max"] = json::array();
+		const GLAccessor& accessor = *this->accessors[i];
+		writer.beginObject();
+		writer.key("bufferView").value(accessor.bufferview_index);
+		writer.key("byteOffset").value(accessor.byte_offset);
+		writer.key("type").value(GLTFAccTypeToString[(int)accessor.type]);
+		writer.key("componentType").value(GLTFCompTypeToInt[(int)accessor.component_type]);
+		writer.key("count").value(accessor.count);
+		if (accessor.normalized) {
+			writer.key("normalized").value(true);
+		}
+		limit = GLTFAccTypeToInt(accessor.type);
+
+		if (accessor.max != nullptr) {
+			writer.key("max").beginArray();
 			for (j = 0; j < limit; j++) {
-				GLTFCompTypePushBack(
-					this->accessors[i]->component_type,
-					(*subdata)["max"],
-					this->accessors[i]->max[j]
-				);
+				GLTFCompTypeWrite(accessor.component_type, writer, accessor.max[j]);
 			}
+			writer.endArray();
 		}
-		if (this->accessors[i]->min != nullptr) {
-			(*subdata)["min"] = json::array();
+		if (accessor.min != nullptr) {
+			writer.key("min").beginArray();
 			for (j = 0; j < limit; j++) {
-				GLTFCompTypePushBack(
-					this->accessors[i]->component_type,
-					(*subdata)["min"],
-					this->accessors[i]->min[j]
-				);
+				GLTFCompTypeWrite(accessor.component_type, writer, accessor.min[j]);
 			}
+			writer.endArray();
 		}
-		data["accessors"].push_back(*subdata);
+		writer.endObject();
 	}
+	if (this->accessors.size() > 0) writer.endArray();
 
 	// BufferViews
-	if (this->buffer_views.size() > 0) data["bufferViews"] = json::array();
+	if (this->buffer_views.size() > 0) writer.key("bufferViews").beginArray();
 	for (i = 0; i < this->buffer_views.size(); i++) {
-		subdata = new json({});
-
-		if (!single_glb) {
-			(*subdata)["buffer"] = this->buffer_views[i]->buffer_index;
-		// GLB writes single buffer chunk, force index to zero (will update offset below)
-		} else {
-			(*subdata)["buffer"] = 0;
+		const GLBufferView& view = *this->buffer_views[i];
+		writer.beginObject();
+		writer.key("buffer").value(buffer_index[view.buffer_index]);
+		writer.key("byteLength").value(view.byte_length);
+		writer.key("byteOffset").value(view.byte_offset + buffer_shift[view.buffer_index]);
+
+		if (view.byte_stride != 0) {
+			writer.key("byteStride").value(view.byte_stride);
 		}
-
-		(*subdata)["byteLength"] = this->buffer_views[i]->byte_length;
-
-		// GLB writes single buffer chunk, adjust offset with padding
-		if (single_glb) {
-			// Get offset from valid previous index
-			if (this->buffer_views[i]->buffer_index - 1 >= 0) {
-				buffer_shift = this->buffers[this->buffer_views[i]->buffer_index - 1]->data.size();
-			} else buffer_shift = 0;
-			(*subdata)["byteOffset"] = this->buffer_views[i]->byte_offset
-								     + buffer_shift;
-		} else {
-			(*subdata)["byteOffset"] = this->buffer_views[i]->byte_offset;
+		if (view.target != GLTFBVTarget::NONE) {
+			writer.key("target").value(GLTFBVTargetToInt(view.target));
 		}
-
-		if (this->buffer_views[i]->byte_stride != 0) {
-			(*subdata)["byteStride"] = this->buffer_views[i]->byte_stride;
+		const GLMeshopt& meshopt = view.meshopt;
+		if (meshopt.mode != GLTFMeshoptMode::NONE) {
+			writer.key("extensions").beginObject();
+			writer.key("EXT_meshopt_compression").beginObject();
+			writer.key("buffer").value(buffer_index[meshopt.buffer_index]);
+			writer.key("byteOffset").value(meshopt.byte_offset + buffer_shift[meshopt.buffer_index]);
+			writer.key("byteLength").value(meshopt.byte_length);
+			writer.key("byteStride").value(meshopt.byte_stride);
+			writer.key("mode").value(GLTFMeshoptModeToString[(int)meshopt.mode]);
+			writer.key("count").value(meshopt.count);
+			writer.endObject();
+			writer.endObject();
 		}
-		(*subdata)["target"] = GLTFBVTargetToInt(this->buffer_views[i]->target);
-		data["bufferViews"].push_back(*subdata);
+		writer.endObject();
 	}
+	if (this->buffer_views.size() > 0) writer.endArray();
 
-	// Buffers
-	if (this->buffers.size() > 0) data["buffers"] = json::array();
+	// Buffers, omitted if empty
+	if (saved_buffer_count > 0) writer.key("buffers").beginArray();
 	// GLTF, Write individual buffer files
 	if (!single_glb) {
 		for (i = 0; i < this->buffers.size(); i++) {
-			if (this->buffers[i]->data.size() == 0) continue;
+			if (this->buffers[i]->byte_length == 0) continue;
+			if (this->buffers[i]->fallback) {
+				writeFallbackBuffer(writer, this->buffers[i]->byte_length);
+				continue;
+			}
 			bin_filename = f_base_filename_no_ext(filename)
 						+ "_" + std::to_string(i) + ".bin";
 
-			subdata = new json({});
-			(*subdata)["byteLength"] = this->buffers[i]->data.size();
-			(*subdata)["uri"] = bin_filename;
-			data["buffers"].push_back(*subdata);
-
-			// Write binary file data: verts, norms, uvs
-			std::ofstream f((base_dir + bin_filename).c_str(), std::ios::binary);
-			if (!f.is_open()) {
-				throw SaveException("Cannot open file for writing \"" + bin_filename + "\"");
-			}
-			f.write(
-				reinterpret_cast<const char*>(this->buffers[i]->data.data()),
-				this->buffers[i]->data.size()
-			);
-			f.close();
+			writer.beginObject();
+			writer.key("byteLength").value(this->buffers[i]->byte_length);
+			writer.key("uri").value(bin_filename);
+			writer.endObject();
+			bin_buffers.push_back(i);
 		}
 	// GLB, buffers will be appended to single binary file later
 	} else {
-		uint32_t total_size = 0;
-		for (i = 0; i < this->buffers.size(); i++) {
-			total_size += this->buffers[i]->data.size();
+		if (glb_bin_bytes > 0) {
+			writer.beginObject();
+			writer.key("byteLength").value(glb_bin_bytes);
+			writer.endObject();
 		}
-		if (total_size > 0) {
-			subdata = new json({});
-			(*subdata)["byteLength"] = total_size;
-			data["buffers"].push_back(*subdata);
+		for (i = 0; i < this->buffers.size(); i++) {
+			if (!this->buffers[i]->fallback) continue;
+			writeFallbackBuffer(writer, this->buffers[i]->byte_length);
 		}
 	}
-	// If empty, remove buffers
-	if (data["buffers"].size() == 0) data.erase("buffers");
-
-	// Write GLTF JSON file
-	if (!single_glb) {
-		std::ofstream f(filename);
-		if (!f.is_open()) {
-			throw SaveException("Cannot open file for writing \"" + std::string(filename) + "\"");
+	if (saved_buffer_count > 0) writer.endArray();
+
+	writer.endObject();
+	writer.flush();
+
+	// Write binary files data: verts, norms, uvs (one file per buffer, concurrently)
+	parallelFor(bin_buffers.size(), 1, [&](int start, int end) {
+		for (int n = start; n < end; n++) {
+			std::string bin_path = base_dir + f_base_filename_no_ext(filename)
+								 + "_" + std::to_string(bin_buffers[n]) + ".bin";
+			std::ofstream bf(bin_path.c_str(), std::ios::binary);
+			if (!bf.is_open()) {
+				throw SaveException("Cannot open file for writing \"" + bin_path + "\"");
+			}
+			this->buffers[bin_buffers[n]]->write(bf);
+			bf.close();
 		}
-		f << data.dump();
-		f.close();
-	// Write GLB file
-	} else {
-		uint32_t size_total_bytes = 0;
+	});
+
+	// Write GLB binary chunk and fill in the header
+	if (single_glb) {
+		uint64_t size_total_bytes = 0;
+		uint32_t glb_total_bytes;
 		uint32_t json_bytes;
 		uint32_t buffer_bytes;
+		uint64_t json_stream_bytes;
+		uint64_t written;
 		int json_bytes_padding;
 		int buffer_bytes_padding;
 		const char bin_version[] = {0x02, 0x00, 0x00, 0x00};
-		std::string json_str = data.dump();
 
 		// Get paddings and total size
-		json_bytes = json_str.size();
-		json_bytes_padding = (4 - (json_bytes % 4)) % 4;
-		json_bytes += json_bytes_padding;
-
-		buffer_bytes = 0;
-		for (i = 0; i < this->buffers.size(); i++) {
-			// Add one byte for trailing 0x00 for padding
-			buffer_bytes += this->buffers[i]->data.size();
-		}
-		buffer_bytes_padding = (4 - (buffer_bytes % 4)) % 4;
-		buffer_bytes += buffer_bytes_padding;
-
+		json_stream_bytes = (uint64_t)f.tellp() - 20;
+		json_bytes_padding = (4 - (json_stream_bytes % 4)) % 4;
 		size_total_bytes += 12;  // Header
-		size_total_bytes += 8 + json_bytes;
-		if (buffer_bytes > 0) size_total_bytes += 8 + buffer_bytes;
-
-		std::ofstream f(filename, std::ios::binary);
-		if (!f.is_open()) {
-			throw SaveException("Cannot open file for writing \"" + std::string(filename) + "\"");
+		size_total_bytes += 8 + json_stream_bytes + json_bytes_padding;
+		if (glb_bin_bytes > 0) size_total_bytes += 8 + ((glb_bin_bytes + 3) & ~3);
+		// JSON pushed it past the 32 bit lengths
+		if (size_total_bytes > GLB_MAX_BYTES) {
+			f.close();
+			std::filesystem::remove(filename);
+			this->saveAsGLTFFallback(filename);
+			return;
 		}
 
-		// Header (magic, version, length (total size))
-		f.write("glTF", 4);
-		f.write(bin_version, 4);
-		f.write(reinterpret_cast<const char*>(&size_total_bytes), 4);
-
-		// JSON data chunk (length, type, data)
-		f.write(reinterpret_cast<const char*>(&json_bytes), 4);
-		f.write("JSON", 4);
-		f.write(json_str.c_str(), json_str.size());
+		glb_total_bytes = size_total_bytes;
+		json_bytes = json_stream_bytes + json_bytes_padding;
 		while (json_bytes_padding > 0) {
 			f.write(" ", 1);
 			json_bytes_padding -= 1;
 		}
 
+		buffer_bytes = glb_bin_bytes;
+		buffer_bytes_padding = (4 - (buffer_bytes % 4)) % 4;
+		buffer_bytes += buffer_bytes_padding;
+
 		// Buffer data chunk (length, type, data) <- sad we can't have multiple buffer chunks
 		// Ignore chunck if buffers are empty
 		if (buffer_bytes > 0) {
 			f.write(reinterpret_cast<const char*>(&buffer_bytes), 4);
 			f.write("BIN\0", 4);
+			written = 0;
 			for (i = 0; i < this->buffers.size(); i++) {
-				f.write(
-					reinterpret_cast<const char*>(this->buffers[i]->data.data()),
-					this->buffers[i]->data.size()
-				);
+				if (this->buffers[i]->fallback) continue;
+				while (written < buffer_shift[i]) {
+					f.write("\0", 1);
+					written += 1;
+				}
+				this->buffers[i]->write(f);
+				written += this->buffers[i]->byte_length;
 			}
 			while (buffer_bytes_padding > 0) {
 				f.write("\0", 1);
 				buffer_bytes_padding -= 1;
 			}
 		}
-		f.close();
+
+		// Header (magic, version, length (total size))
+		f.seekp(0);
+		f.write("glTF", 4);
+		f.write(bin_version, 4);
+		f.write(reinterpret_cast<const char*>(&glb_total_bytes), 4);
+
+		// JSON data chunk (length, type), data was streamed after it
+		f.write(reinterpret_cast<const char*>(&json_bytes), 4);
+		f.write("JSON", 4);
 	}
+	f.close();
 }
 
-std::unordered_map<std::string, int> glmesh_cache;
+class GLMeshCacheKey {
+public:
+	uint32_t ul_id;
+	MaterialKey material_key;
 
+	bool operator==(const GLMeshCacheKey& key) const {
+		return this->ul_id == key.ul_id && this->material_key == key.material_key;
+	}
+};
+
+namespace std {
+	template <>
+	struct hash<GLMeshCacheKey> {
+		size_t operator()(const GLMeshCacheKey& key) const {
+			return std::hash<uint64_t>()(key.material_key ^ ((uint64_t)key.ul_id * 0x9E3779B97F4A7C15ull));
+		}
+	};
+}
+
+/// Content hash of an accessor payload, two independent 64 bit hashes so collisions are negligible
+class GLContentKey {
+public:
+	uint64_t hash;
+	uint64_t check;
+
+	GLContentKey();
+	void add(uint32_t word);
+	void add(float value);
+	bool operator==(const GLContentKey& key) const {
+		return this->hash == key.hash && this->check == key.check;
+	}
+};
+
+GLContentKey::GLContentKey() {
+	this->hash = 0xCBF29CE484222325ull;
+	this->check = 0;
+}
+
+void GLContentKey::add(uint32_t word) {
+	// FNV-1a over words, and a multiply-rotate hash
+	this->hash = (this->hash ^ word) * 0x100000001B3ull;
+	this->check += word * 0x9E3779B97F4A7C15ull;
+	this->check = ((this->check << 31) | (this->check >> 33)) * 0xC2B2AE3D27D4EB4Full;
+}
+
+void GLContentKey::add(float value) {
+	uint32_t word;
+	std::memcpy(&word, &value, sizeof(uint32_t));
+	this->add(word);
+}
+
+namespace std {
+	template <>
+	struct hash<GLContentKey> {
+		size_t operator()(const GLContentKey& key) const {
+			return key.hash;
+		}
+	};
+}
+
+std::unordered_map<GLMeshCacheKey, int> glmesh_cache;
+// Accessors by payload, primitives with identical indices or vertices share them
+std::unordered_map<GLContentKey, int> glindex_cache;
+std::unordered_map<GLContentKey, GLMeshAttrs> glvertex_cache;
+// Material index by MaterialKey, primitives with matching materials share one
+std::unordered_map<MaterialKey, int> glmaterial_cache;
+std::unordered_set<Node*> glinstanced;
+
+/// Faces of one surface from face_start up to face_end
+class MeshGroupSpan {
+public:
+	int surface_index;
+	int face_start;
+	int face_end;
+};
+
+/// Faces sharing a material, exported as one primitive
 class MeshGroup {
 public:
 	Material* material;
-	std::vector<int> indices;
-	std::vector<Vector3> verts;
-	std::vector<Vector3> norms;
+	std::vector<MeshGroupSpan> spans;
+	bool has_uvs;
+	// Quantized positions are (vert - offset) / scale as unsigned shorts, normals as bytes
+	bool quantized;
+	// UVs within [0, 1] are quantized to unsigned shorts as well
+	bool quantized_uvs;
+	// Meshopt index compression only takes 16 or 32 bit indices
+	bool compressed;
+	Vector3 offset;
+	float scale;
+	// Filled by remapMeshGroup
+	int index_count;
+	int vert_count;
+	Vector3 min;
+	Vector3 max;
+	// Source content of the index sequence and of the unique vertices
+	GLContentKey index_content;
+	GLContentKey vertex_content;
+
+	/// Payload keys, the content combined with the layout it is written in
+	GLContentKey indexKey() const;
+	GLContentKey vertexKey() const;
+	/// Smallest index component holding every vertex index
+	GLTFCompType indexType() const;
+	int indexSize() const;
+	/// Interleaved vertex layout: position, normal, and optional UV
+	int normalOffset() const;
+	int uvOffset() const;
+	int stride() const;
 };
 
-int addMesh(GLTF& gltf, MeshObj& mnode);
-void buildMeshGroupFromMeshObj(MeshObj& mnode, std::vector<MeshGroup>& groups);
-template <typename T>
-int addBufferWithViewAndAccessor(GLTF& gltf, std::vector<T>& source);
-template <typename T>
-void getBoundsArray(T* values, size_t count, uint32_t* min, uint32_t* max);
+/// Cache key and (if the mesh is not a cache hit) groups of a mesh node, prepared ahead of addMesh
+class GLMeshStage {
+public:
+	MeshObj* mnode;
+	GLMeshCacheKey cache_key;
+	bool build;
+	std::vector<MeshGroup> groups;
+};
 
-void buildGLTFFromSceneChildren(GLTF& gltf, Node& root, GLNode* parent_node) {
+// Mesh nodes staged in parallel by stageMeshGroups, taken by addMesh in order
+std::vector<GLMeshStage> glmesh_stages;
+int glmesh_stage_next = 0;
+
+/// Distinct normal and UV seen with a vertex, chained per vertex
+class MeshGroupCorner {
+public:
+	int norm_index;
+	int uv_index;
+	int out_index;
+	int next;
+};
+
+GLTFCompType MeshGroup::indexType() const {
+	if (!this->quantized) return GLTFCompType::UNSIGNED_INT;
+	// The largest value of each type is reserved for primitive restart
+	if (this->vert_count <= UINT8_MAX && !this->compressed) return GLTFCompType::UNSIGNED_BYTE;
+	if (this->vert_count <= UINT16_MAX) return GLTFCompType::UNSIGNED_SHORT;
+	return GLTFCompType::UNSIGNED_INT;
+}
+
+int MeshGroup::indexSize() const {
+	switch (this->indexType()) {
+		case GLTFCompType::UNSIGNED_BYTE:
+			return sizeof(uint8_t);
+		case GLTFCompType::UNSIGNED_SHORT:
+			return sizeof(uint16_t);
+		default:
+			return sizeof(uint32_t);
+	}
+}
+
+// Quantized attributes are padded to 4 bytes, as glTF requires for vertex attributes
+int MeshGroup::normalOffset() const {
+	return this->quantized ? sizeof(uint16_t) * 4 : sizeof(Vector3);
+}
+
+int MeshGroup::uvOffset() const {
+	return this->normalOffset() + (this->quantized ? sizeof(int8_t) * 4 : sizeof(Vector3));
+}
+
+int MeshGroup::stride() const {
+	if (!this->has_uvs) return this->uvOffset();
+	return this->uvOffset() + (this->quantized_uvs ? sizeof(uint16_t) * 2 : sizeof(Vector2));
+}
+
+GLContentKey MeshGroup::indexKey() const {
+	GLContentKey key = this->index_content;
+	key.add((uint32_t)this->indexType());
+	key.add((uint32_t)this->index_count);
+	return key;
+}
+
+GLContentKey MeshGroup::vertexKey() const {
+	GLContentKey key = this->vertex_content;
+	key.add((uint32_t)this->stride());
+	key.add((uint32_t)this->vert_count);
+	key.add((uint32_t)this->has_uvs | (uint32_t)this->quantized << 1 | (uint32_t)this->quantized_uvs << 2);
+	if (this->quantized) {
+		key.add(this->offset.x);
+		key.add(this->offset.y);
+		key.add(this->offset.z);
+		key.add(this->scale);
+	}
+	return key;
+}
+
+/// Map [0, 1] to the full unsigned short range
+inline uint16_t quantizeUnorm16(float value) {
+	return (uint16_t)roundf(std::clamp(value, 0.0f, 1.0f) * UINT16_MAX);
+}
+
+/// Map [-1, 1] to a signed byte
+inline int8_t quantizeSnorm8(float value) {
+	return (int8_t)roundf(std::clamp(value, -1.0f, 1.0f) * INT8_MAX);
+}
+
+int addMesh(GLTF& gltf, MeshObj& mnode, const GLTFOptions& options);
+int addMaterial(GLTF& gltf, const Material& mmat);
+GLMeshCacheKey getMeshCacheKey(MeshObj& mnode);
+void stageMeshGroups(Node& scene);
+void buildMeshGroupFromMeshObj(MeshObj& mnode, std::vector<MeshGroup>& groups);
+void quantizeMeshGroups(const ObjGeometry& geometry, GLMesh& mesh, std::vector<MeshGroup>& groups);
+void remapMeshGroup(const ObjGeometry& geometry, MeshGroup& group, std::byte* indices, std::byte* verts);
+int addBufferView(GLTF& gltf, int buffer_index, int byte_offset, int byte_length, int byte_stride, GLTFBVTarget target);
+int addAccessor(GLTF& gltf, int bufferview_index, int byte_offset, int count, GLTFAccType acc_type, GLTFCompType comp_type, bool bounds);
+int addInstanceAccessor(GLTF& gltf, std::vector<float>& source, GLTFAccType type);
+void compressGLTFBuffers(GLTF& gltf);
+
+void buildGLTFFromSceneChildren(GLTF& gltf, Node& root, GLNode* parent_node, const GLTFOptions& options) {
 	int mesh_index;
+	GLMesh* mesh;
 	GLNode* node;
+	GLNode* dequant_node;
 	GLScene* scene = gltf.scenes[0];
 
+	// Instanced meshes are emitted separately (see addInstancedNodes)
+	if (glinstanced.find(&root) != glinstanced.end()) return;
+
 	node = new GLNode(root.name.c_str(), &root.position, &root.scale, &root.rotation);
 
 	if (root.type == NodeType::MeshObj) {
-		mesh_index = addMesh(gltf, *(MeshObj*)&root);
+		mesh_index = addMesh(gltf, *(MeshObj*)&root, options);
 		node->mesh_index = mesh_index;
 	}
 
 	for (int i = 0; i < root.children.size(); i++) {
-		buildGLTFFromSceneChildren(gltf, *root.children[i], node);
+		buildGLTFFromSceneChildren(gltf, *root.children[i], node, options);
+	}
+
+	// Apply the mesh's dequantization: folded into the node's own transform when it has
+	// no children, otherwise in a child node so the children are unaffected
+	mesh = node->mesh_index >= 0 ? gltf.meshes[node->mesh_index] : nullptr;
+	if (mesh != nullptr && mesh->dequant_translation != nullptr) {
+		if (node->child_indicies.size() == 0) {
+			node->translation = new Vector3(root.position + root.rotation * (root.scale * *mesh->dequant_translation));
+			node->scale = new Vector3(root.scale * *mesh->dequant_scale);
+			node->owns_transform = true;
+		} else {
+			dequant_node = new GLNode(node->name, mesh->dequant_translation, mesh->dequant_scale, nullptr);
+			dequant_node->mesh_index = node->mesh_index;
+			node->mesh_index = -1;
+			gltf.nodes.push_back(dequant_node);
+			node->addChild(gltf.nodes.size() - 1);
+		}
 	}
 
 	// Screen for and ignore empty nodes
@@ -552,85 +978,278 @@ void buildGLTFFromSceneChildren(GLTF& gltf, Node& root, GLNode* parent_node) {
 	else parent_node->addChild(gltf.nodes.size() - 1);
 }
 
-GLTF* createGLTFFromScene(Node& scene) {
+void collectInstanceGroups(Node& root, std::vector<GLMeshCacheKey>& order, std::unordered_map<GLMeshCacheKey, std::vector<MeshObj*>>& groups) {
+	MeshObj* mnode;
+	GLMeshCacheKey key;
+	for (int i = 0; i < root.children.size(); i++) {
+		if (root.children[i]->type == NodeType::Node) {
+			collectInstanceGroups(*root.children[i], order, groups);
+			continue;
+		}
+		mnode = (MeshObj*)root.children[i];
+		// Only meshes straight from a model load share geometry
+		if (mnode->mesh.ul_id == 0 || mnode->mesh.geometry->surfaces.size() == 0) continue;
+		key.ul_id = mnode->mesh.ul_id;
+		key.material_key = getEntityMaterialKey(*mnode);
+		std::vector<MeshObj*>& group = groups[key];
+		if (group.size() == 0) order.push_back(key);
+		group.push_back(mnode);
+	}
+}
+
+/// Emit one node per group of repeated entities (same model and material)
+/// with per-instance global TRS through EXT_mesh_gpu_instancing.
+/// Instance scale is per entity, so differently sized shapes still share a group.
+void addInstancedNodes(GLTF& gltf, Node& scene, const GLTFOptions& options) {
+	int mesh_index;
+	GLMesh* mesh;
+	GLNode* node;
+	Vector3 position;
+	Vector3 scale;
+	Vector3 offset;
+	Quaternion rotation;
+	std::string name;
+	std::vector<float> translations;
+	std::vector<float> rotations;
+	std::vector<float> scales;
+	std::vector<GLMeshCacheKey> order;
+	std::unordered_map<GLMeshCacheKey, std::vector<MeshObj*>> groups;
+
+	collectInstanceGroups(scene, order, groups);
+	for (const GLMeshCacheKey& key : order) {
+		std::vector<MeshObj*>& group = groups[key];
+		// Not worth instancing a single entity
+		if (group.size() < 2) continue;
+
+		mesh_index = addMesh(gltf, *group[0], options);
+		if (mesh_index < 0) continue;
+		mesh = gltf.meshes[mesh_index];
+
+		translations.clear();
+		rotations.clear();
+		scales.clear();
+		for (MeshObj* mnode : group) {
+			position = mnode->globalPosition();
+			rotation = mnode->globalRotation();
+			scale = mnode->scale;
+			// Instance transforms apply after the mesh, so fold dequantization into them
+			if (mesh->dequant_translation != nullptr) {
+				offset = scale * *mesh->dequant_translation;
+				position = position + rotation * offset;
+				scale = scale * *mesh->dequant_scale;
+			}
+			translations.insert(translations.end(), {position.x, position.y, position.z});
+			rotations.insert(rotations.end(), {rotation.x, rotation.y, rotation.z, rotation.w});
+			scales.insert(scales.end(), {scale.x, scale.y, scale.z});
+			glinstanced.insert(mnode);
+		}
+
+		name = "Instances (" + std::to_string(group.size()) + ") " + group[0]->name;
+		node = new GLNode(name.substr(0, sizeof(node->name) - 1).c_str(), nullptr, nullptr, nullptr);
+		node->mesh_index = mesh_index;
+		node->instance_translation_index = addInstanceAccessor(gltf, translations, GLTFAccType::VEC3);
+		node->instance_rotation_index = addInstanceAccessor(gltf, rotations, GLTFAccType::VEC4);
+		node->instance_scale_index = addInstanceAccessor(gltf, scales, GLTFAccType::VEC3);
+		gltf.nodes.push_back(node);
+		gltf.scenes[0]->addNode(gltf.nodes.size() - 1);
+	}
+
+	if (glinstanced.size() > 0) {
+		gltf.extensions_used.push_back("EXT_mesh_gpu_instancing");
+		// Without the extension, viewers would only draw one instance of each group
+		gltf.extensions_required.push_back("EXT_mesh_gpu_instancing");
+	}
+}
+
+GLTF* createGLTFFromScene(Node& scene, const GLTFOptions& options) {
 	GLTF* gltf = new GLTF();
 	gltf->scenes.push_back(new GLScene());
 	gltf->buffers.push_back(new GLBuffer());
-	buildGLTFFromSceneChildren(*gltf, scene, NULL);
+	glinstanced.clear();
+	glmaterial_cache.clear();
+	glindex_cache.clear();
+	glvertex_cache.clear();
+	if (options.instancing) {
+		addInstancedNodes(*gltf, scene, options);
+	}
+	stageMeshGroups(scene);
+	buildGLTFFromSceneChildren(*gltf, scene, NULL, options);
+	glmesh_stages.clear();
+	if (options.quantize && gltf->meshes.size() > 0) {
+		gltf->extensions_used.push_back("KHR_mesh_quantization");
+		gltf->extensions_required.push_back("KHR_mesh_quantization");
+	}
+	if (options.compress) {
+		compressGLTFBuffers(*gltf);
+	}
 	gltf->default_scene_index = 0;
 	return gltf;
 }
 
-int addMesh(GLTF& gltf, MeshObj& mnode) {
-	Material* mmat;
-	GLMaterial* material;
+int addMesh(GLTF& gltf, MeshObj& mnode, const GLTFOptions& options) {
 	GLPrimitive* mprim;
 	GLMesh* mesh;
+	GLAccessor* accessor;
 	int i;
-	int attr_index;
+	int byte_offset, buffer_index, index_bytes, index_padded_bytes, vert_bytes, view_index;
+	int64_t block_bytes;
+	bool write_indices, write_verts;
+	Vector3 min, max;
 	int glmesh_index = -1;
-	std::string cache_key = "";
+	GLMeshCacheKey cache_key;
+	GLContentKey index_key, vertex_key;
+	std::unordered_map<GLMeshCacheKey, int>::iterator cached;
+	std::unordered_map<GLContentKey, int>::iterator cached_indices;
+	std::unordered_map<GLContentKey, GLMeshAttrs>::iterator cached_verts;
+	GLMeshStage* staged = nullptr;
 	// TODO: preallocate vectors in gltf where possible
 
-	if (mnode.mesh.surface_count == 0) return -1;
+	if (mnode.mesh.geometry->surfaces.size() == 0) return -1;
 
-	// Get cache key (combination of mesh unique load id and material id)
-	if(mnode.mesh.ul_id != 0) {
-		cache_key = "mesh_" + std::to_string(mnode.mesh.ul_id);
-		cache_key += "_" + getEntityColorUid(mnode);
+	// Get cache key (combination of mesh unique load id and material key)
+	// Meshes without a load id (combined) are never cached
+	if (glmesh_stage_next < glmesh_stages.size() && glmesh_stages[glmesh_stage_next].mnode == &mnode) {
+		staged = &glmesh_stages[glmesh_stage_next];
+		glmesh_stage_next += 1;
+		cache_key = staged->cache_key;
+	} else {
+		cache_key = getMeshCacheKey(mnode);
 	}
+	if (cache_key.ul_id != 0) {
+		cached = glmesh_cache.find(cache_key);
+	} else cached = glmesh_cache.end();
 
 	// Check if cache if mesh was already created
-	if (glmesh_cache.find(cache_key) != glmesh_cache.end()) {
-		glmesh_index = glmesh_cache[cache_key];
+	if (cached != glmesh_cache.end()) {
+		glmesh_index = cached->second;
 	// Create new mesh
 	} else {
-		// Unfirl mesh
+		// Unfirl mesh, unless already staged
 		std::vector<MeshGroup> groups;
-		buildMeshGroupFromMeshObj(mnode, groups);
-		mesh = new GLMesh();
+		if (staged != nullptr && staged->build) {
+			groups = std::move(staged->groups);
+		} else {
+			buildMeshGroupFromMeshObj(mnode, groups);
+		}
 
 		// Empty mesh
 		if (groups.size() == 0) return -1;
+		mesh = new GLMesh();
+		if (options.quantize) quantizeMeshGroups(*mnode.mesh.geometry, *mesh, groups);
+		for (MeshGroup& group : groups) {
+			group.compressed = options.compress;
+		}
 
 		for (i = 0; i < groups.size(); i++) {
+			// Identical payloads were already written, reuse their accessors
+			index_key = groups[i].indexKey();
+			vertex_key = groups[i].vertexKey();
+			cached_indices = glindex_cache.find(index_key);
+			cached_verts = glvertex_cache.find(vertex_key);
+			write_indices = cached_indices == glindex_cache.end();
+			write_verts = cached_verts == glvertex_cache.end();
+
+			// Reserve indices followed by interleaved vertices, written when the buffer is streamed
+			// Smaller indices are padded so vertices stay 4 byte aligned
+			block_bytes = (write_indices ? ((int64_t)groups[i].index_count * groups[i].indexSize() + 3) & ~3 : 0)
+						+ (write_verts ? (int64_t)groups[i].vert_count * groups[i].stride() : 0);
+			byte_offset = 0;
+			buffer_index = 0;
+			if (write_indices || write_verts) {
+				// Throws before any of the int sizes below could overflow
+				byte_offset = gltf.addBlock(
+					block_bytes,
+					[geometry = mnode.mesh.geometry, group = groups[i], write_indices, write_verts](std::byte* dest) mutable {
+						int index_padded_bytes = write_indices ? (group.index_count * group.indexSize() + 3) & ~3 : 0;
+						remapMeshGroup(
+							*geometry, group,
+							write_indices ? dest : nullptr,
+							write_verts ? dest + index_padded_bytes : nullptr
+						);
+					},
+					buffer_index
+				);
+			}
+			index_bytes = groups[i].index_count * groups[i].indexSize();
+			index_padded_bytes = write_indices ? (index_bytes + 3) & ~3 : 0;
+			vert_bytes = groups[i].vert_count * groups[i].stride();
+			mprim = new GLPrimitive(-1, -1, GLTFTopoTypes::TRIANGLES);
+			mprim->material_index = addMaterial(gltf, *groups[i].material);
+			mesh->primitives.push_back(mprim);
+
 			// Indices
-			addBufferWithViewAndAccessor<int>(gltf, groups[i].indices);
-		
-			// Create mesh primitive
-			mprim = new GLPrimitive(gltf.accessors.size() - 1, -1, GLTFTopoTypes::TRIANGLES);
+			if (write_indices) {
+				view_index = addBufferView(gltf, buffer_index, byte_offset, index_bytes, 0, GLTFBVTarget::ELEMENT_ARRAY_BUFFER);
+				mprim->indices = addAccessor(
+					gltf, view_index, 0, groups[i].index_count,
+					GLTFAccType::SCALAR, groups[i].indexType(), true
+				);
+				accessor = gltf.accessors.back();
+				accessor->min[0] = 0;
+				accessor->max[0] = groups[i].vert_count - 1;
+				glindex_cache[index_key] = mprim->indices;
+			} else {
+				mprim->indices = cached_indices->second;
+			}
+
+			if (!write_verts) {
+				mprim->attributes = cached_verts->second;
+				continue;
+			}
 			mprim->attributes = GLMeshAttrs();
-			mesh->primitives.push_back(mprim);
-		
-			// Position
-			attr_index = addBufferWithViewAndAccessor<Vector3>(gltf, groups[i].verts);
-			mprim->attributes.position_index = attr_index;
-
-			// Material
-			mmat = groups[i].material;
-			material = new GLMaterial();
-			material->matalic = 0.0f;
-			material->roughness = 1.0f;
-			material->base_color[0] = mmat->diffuse.x;
-			material->base_color[1] = mmat->diffuse.y;
-			material->base_color[2] = mmat->diffuse.z;
-			material->base_color[3] = mmat->dissolve;
-			if (mmat->dissolve < 1.0f) {
-				material->alpha_mode = GLTFAlphaMode::BLEND;
+
+			// Vertex attributes share one strided view
+			view_index = addBufferView(
+				gltf, buffer_index, byte_offset + index_padded_bytes, vert_bytes, groups[i].stride(), GLTFBVTarget::ARRAY_BUFFER
+			);
+			if (groups[i].quantized) {
+				mprim->attributes.position_index = addAccessor(
+					gltf, view_index, 0, groups[i].vert_count,
+					GLTFAccType::VEC3, GLTFCompType::UNSIGNED_SHORT, true
+				);
+				accessor = gltf.accessors.back();
+				accessor->normalized = true;
+				// Quantizing is monotonic, so the bounds quantize to the quantized bounds
+				min = (groups[i].min - groups[i].offset) / groups[i].scale;
+				max = (groups[i].max - groups[i].offset) / groups[i].scale;
+				accessor->min[0] = quantizeUnorm16(min.x);
+				accessor->min[1] = quantizeUnorm16(min.y);
+				accessor->min[2] = quantizeUnorm16(min.z);
+				accessor->max[0] = quantizeUnorm16(max.x);
+				accessor->max[1] = quantizeUnorm16(max.y);
+				accessor->max[2] = quantizeUnorm16(max.z);
+				mprim->attributes.normal_index = addAccessor(
+					gltf, view_index, groups[i].normalOffset(), groups[i].vert_count,
+					GLTFAccType::VEC3, GLTFCompType::BYTE, false
+				);
+				gltf.accessors.back()->normalized = true;
+			} else {
+				mprim->attributes.position_index = addAccessor(
+					gltf, view_index, 0, groups[i].vert_count,
+					GLTFAccType::VEC3, GLTFCompType::FLOAT, true
+				);
+				accessor = gltf.accessors.back();
+				std::memcpy(accessor->min, &groups[i].min, sizeof(uint32_t) * 3);
+				std::memcpy(accessor->max, &groups[i].max, sizeof(uint32_t) * 3);
+				mprim->attributes.normal_index = addAccessor(
+					gltf, view_index, groups[i].normalOffset(), groups[i].vert_count,
+					GLTFAccType::VEC3, GLTFCompType::FLOAT, false
+				);
 			}
-			if (mmat->emissive.x > 0.0f || mmat->emissive.y > 0.0f || mmat->emissive.z > 0.0f) {
-				material->emissive[0] = mmat->emissive.x;
-				material->emissive[1] = mmat->emissive.y;
-				material->emissive[2] = mmat->emissive.z;
+			if (groups[i].has_uvs) {
+				mprim->attributes.texcoord_0_index = addAccessor(
+					gltf, view_index, groups[i].uvOffset(), groups[i].vert_count, GLTFAccType::VEC2,
+					groups[i].quantized_uvs ? GLTFCompType::UNSIGNED_SHORT : GLTFCompType::FLOAT, false
+				);
+				gltf.accessors.back()->normalized = groups[i].quantized_uvs;
 			}
-			gltf.materials.push_back(material);
-			mprim->material_index = gltf.materials.size() - 1;
+			glvertex_cache[vertex_key] = mprim->attributes;
 		}
 	
 		// Finalize
 		gltf.meshes.push_back(mesh);
 		glmesh_index = gltf.meshes.size() - 1;
-		if (cache_key.size() > 0) {
+		if (cache_key.ul_id != 0) {
 			glmesh_cache[cache_key] = glmesh_index;
 		}
 	}
@@ -638,105 +1257,491 @@ int addMesh(GLTF& gltf, MeshObj& mnode) {
 	return glmesh_index;
 }
 
+/// Shared by every material with the same MaterialKey (diffuse, emissive, and dissolve)
+int addMaterial(GLTF& gltf, const Material& mmat) {
+	GLMaterial* material;
+	MaterialKey key = mmat.getKey();
+	std::unordered_map<MaterialKey, int>::iterator cached = glmaterial_cache.find(key);
+
+	if (cached != glmaterial_cache.end()) return cached->second;
+
+	material = new GLMaterial();
+	material->matalic = 0.0f;
+	material->roughness = 1.0f;
+	material->base_color[0] = mmat.diffuse.x;
+	material->base_color[1] = mmat.diffuse.y;
+	material->base_color[2] = mmat.diffuse.z;
+	material->base_color[3] = mmat.dissolve;
+	if (mmat.dissolve < 1.0f) {
+		material->alpha_mode = GLTFAlphaMode::BLEND;
+	}
+	if (mmat.emissive.x > 0.0f || mmat.emissive.y > 0.0f || mmat.emissive.z > 0.0f) {
+		material->emissive[0] = mmat.emissive.x;
+		material->emissive[1] = mmat.emissive.y;
+		material->emissive[2] = mmat.emissive.z;
+	}
+	gltf.materials.push_back(material);
+	glmaterial_cache[key] = gltf.materials.size() - 1;
+	return gltf.materials.size() - 1;
+}
+
+GLMeshCacheKey getMeshCacheKey(MeshObj& mnode) {
+	GLMeshCacheKey cache_key;
+	cache_key.ul_id = mnode.mesh.ul_id;
+	cache_key.material_key = cache_key.ul_id != 0 ? getEntityMaterialKey(mnode) : 0;
+	return cache_key;
+}
+
+/// Mesh nodes reached by buildGLTFFromSceneChildren, in the order it reaches them
+void collectMeshesToStage(Node& root, std::vector<GLMeshStage>& stages) {
+	if (glinstanced.find(&root) != glinstanced.end()) return;
+
+	if (root.type == NodeType::MeshObj && ((MeshObj*)&root)->mesh.geometry->surfaces.size() > 0) {
+		stages.emplace_back();
+		stages.back().mnode = (MeshObj*)&root;
+		stages.back().build = false;
+	}
+	for (int i = 0; i < root.children.size(); i++) {
+		collectMeshesToStage(*root.children[i], stages);
+	}
+}
+
+/// Cache keys and groups of every mesh the scene will add, built in parallel.
+/// Only the first node of each cache key builds groups, addMesh takes them in scene order.
+void stageMeshGroups(Node& scene) {
+	std::vector<GLMeshStage>& stages = glmesh_stages;
+	std::unordered_set<GLMeshCacheKey> seen;
+
+	stages.clear();
+	glmesh_stage_next = 0;
+
+	collectMeshesToStage(scene, stages);
+	parallelFor(stages.size(), 64, [&](int start, int end) {
+		for (int n = start; n < end; n++) {
+			stages[n].cache_key = getMeshCacheKey(*stages[n].mnode);
+		}
+	});
+	for (GLMeshStage& stage : stages) {
+		if (stage.cache_key.ul_id == 0) {
+			stage.build = true;
+		} else if (glmesh_cache.find(stage.cache_key) == glmesh_cache.end()) {
+			stage.build = seen.insert(stage.cache_key).second;
+		}
+	}
+	parallelFor(stages.size(), 8, [&](int start, int end) {
+		for (int n = start; n < end; n++) {
+			if (stages[n].build) buildMeshGroupFromMeshObj(*stages[n].mnode, stages[n].groups);
+		}
+	});
+}
+
 void buildMeshGroupFromMeshObj(MeshObj& mnode, std::vector<MeshGroup>& groups) {
-	int i, j, k;
-	int vert_idx;
+	int i, face_start, face_count;
+	const ObjGeometry& geometry = *mnode.mesh.geometry;
 	MeshGroup* cur_grp = nullptr;
-	std::unordered_map<int, int> index_map;
-
-	for (i = 0; i < mnode.mesh.surface_count; i++) {
-		for (j = 0; j < mnode.mesh.surfaces[i].face_count; j++) {
-			// New surface material, setup for new mesh group
-			if (mnode.mesh.surfaces[i].material_refs->find(j) != mnode.mesh.surfaces[i].material_refs->end()) {
-				index_map.clear();
-				groups.emplace_back();
-				cur_grp = &groups.back();
-				cur_grp->material = &mnode.mesh.materials[(*mnode.mesh.surfaces[i].material_refs)[j]];
-			}
-			if (cur_grp == nullptr) {
-				continue;
-				// throw GeneralException("Unable to get group from mesh surfaces (missing material)");
+
+	// Each material range starts a new group, faces before any range continue the previous one
+	for (i = 0; i < geometry.surfaces.size(); i++) {
+		const Surface& surface = geometry.surfaces[i];
+		face_count = surface.faces.size();
+		face_start = 0;
+		for (const MaterialRange& range : surface.material_ranges) {
+			if (range.face_start >= face_count) break;
+			if (cur_grp != nullptr && range.face_start > face_start) {
+				cur_grp->spans.push_back({i, face_start, range.face_start});
 			}
-			// Add unique verts only, remap indices to copied verts
+			groups.emplace_back();
+			cur_grp = &groups.back();
+			cur_grp->material = &mnode.mesh.materials[range.name];
+			cur_grp->has_uvs = geometry.uvs.size() > 0;
+			cur_grp->quantized = false;
+			cur_grp->quantized_uvs = false;
+			cur_grp->compressed = false;
+			face_start = range.face_start;
+		}
+		if (cur_grp != nullptr && face_count > face_start) {
+			cur_grp->spans.push_back({i, face_start, face_count});
+		}
+	}
+
+	// Sizes and bounds only, data is written once the buffer layout is final
+	for (MeshGroup& group : groups) {
+		remapMeshGroup(geometry, group, nullptr, nullptr);
+	}
+}
+
+/// Share one dequantization transform across the mesh's groups: the bounds' minimum
+/// and largest extent, kept uniform so normals are unaffected.
+void quantizeMeshGroups(const ObjGeometry& geometry, GLMesh& mesh, std::vector<MeshGroup>& groups) {
+	bool first = true;
+	bool unit_uvs = true;
+	float scale;
+	Vector3 min, max, extent;
+
+	for (const MeshGroup& group : groups) {
+		if (group.vert_count == 0) continue;
+		if (first) {
+			min = group.min;
+			max = group.max;
+			first = false;
+			continue;
+		}
+		min = Vector3(std::min(min.x, group.min.x), std::min(min.y, group.min.y), std::min(min.z, group.min.z));
+		max = Vector3(std::max(max.x, group.max.x), std::max(max.y, group.max.y), std::max(max.z, group.max.z));
+	}
+	extent = max - min;
+	scale = std::max(extent.x, std::max(extent.y, extent.z));
+	// Flat or single point mesh
+	if (scale <= 0.0f) scale = 1.0f;
+
+	for (const Vector2& uv : geometry.uvs) {
+		if (uv.x < 0.0f || uv.x > 1.0f || uv.y < 0.0f || uv.y > 1.0f) {
+			unit_uvs = false;
+			break;
+		}
+	}
+
+	for (MeshGroup& group : groups) {
+		group.quantized = true;
+		group.quantized_uvs = unit_uvs;
+		group.offset = min;
+		group.scale = scale;
+	}
+	mesh.dequant_translation = new Vector3(min);
+	mesh.dequant_scale = new Vector3(scale, scale, scale);
+}
+
+/// Number the group's unique vertices (position, normal, UV) in order of first use.
+/// Writes indices and interleaved verts when given, otherwise only counts, bounds, and hashes them.
+void remapMeshGroup(const ObjGeometry& geometry, MeshGroup& group, std::byte* indices, std::byte* verts) {
+	int i, k, c;
+	int vert_idx, norm_idx, uv_idx;
+	int stride = group.stride();
+	int index_size = group.indexSize();
+	bool hashing = indices == nullptr && verts == nullptr;
+	float length;
+	std::byte* out;
+	Vector2 uv;
+	Vector3 normal, position;
+	// First corner of each source vertex, -1 if unused so far
+	std::vector<int> heads(geometry.verts.size(), -1);
+	std::vector<MeshGroupCorner> corners;
+
+	group.index_count = 0;
+	group.vert_count = 0;
+	if (hashing) {
+		group.index_content = GLContentKey();
+		group.vertex_content = GLContentKey();
+	}
+	for (const MeshGroupSpan& span : group.spans) {
+		const Face* faces = geometry.surfaces[span.surface_index].faces.data();
+		for (i = span.face_start; i < span.face_end; i++) {
 			for (k = 0; k < 3; k++) {
-				vert_idx = mnode.mesh.surfaces[i].faces[j].vert_index[k] - 1;
-				if (index_map.find(vert_idx) == index_map.end()) {
-					index_map[vert_idx] = cur_grp->verts.size();
-					cur_grp->verts.push_back(mnode.mesh.verts[vert_idx]);
+				vert_idx = faces[i].vert_index[k] - 1;
+				norm_idx = faces[i].norm_index[k] - 1;
+				uv_idx = group.has_uvs ? faces[i].uv_index[k] - 1 : -1;
+				for (c = heads[vert_idx]; c >= 0; c = corners[c].next) {
+					if (corners[c].norm_index == norm_idx && corners[c].uv_index == uv_idx) break;
+				}
+				if (c < 0) {
+					const Vector3& vert = geometry.verts[vert_idx];
+					if (verts != nullptr) {
+						out = verts + group.vert_count * stride;
+						normal = norm_idx >= 0 ? geometry.norms[norm_idx] : Vector3();
+						length = sqrtf(normal.dot(normal));
+						if (length > 0.0f) normal = normal * (1.0f / length);
+						if (group.quantized) {
+							position = (vert - group.offset) / group.scale;
+							((uint16_t*)out)[0] = quantizeUnorm16(position.x);
+							((uint16_t*)out)[1] = quantizeUnorm16(position.y);
+							((uint16_t*)out)[2] = quantizeUnorm16(position.z);
+							((uint16_t*)out)[3] = 0;
+							((int8_t*)(out + group.normalOffset()))[0] = quantizeSnorm8(normal.x);
+							((int8_t*)(out + group.normalOffset()))[1] = quantizeSnorm8(normal.y);
+							((int8_t*)(out + group.normalOffset()))[2] = quantizeSnorm8(normal.z);
+							((int8_t*)(out + group.normalOffset()))[3] = 0;
+						} else {
+							std::memcpy(out, &vert, sizeof(Vector3));
+							std::memcpy(out + group.normalOffset(), &normal, sizeof(Vector3));
+						}
+						// OBJ UVs start bottom left, glTF top left
+						if (group.has_uvs) {
+							uv = uv_idx >= 0 ? Vector2(geometry.uvs[uv_idx].x, 1.0f - geometry.uvs[uv_idx].y) : Vector2();
+							if (group.quantized_uvs) {
+								((uint16_t*)(out + group.uvOffset()))[0] = quantizeUnorm16(uv.x);
+								((uint16_t*)(out + group.uvOffset()))[1] = quantizeUnorm16(uv.y);
+							} else {
+								std::memcpy(out + group.uvOffset(), &uv, sizeof(Vector2));
+							}
+						}
+					}
+					if (hashing) {
+						normal = norm_idx >= 0 ? geometry.norms[norm_idx] : Vector3();
+						uv = uv_idx >= 0 ? geometry.uvs[uv_idx] : Vector2(0.0f, 1.0f);
+						group.vertex_content.add(vert.x);
+						group.vertex_content.add(vert.y);
+						group.vertex_content.add(vert.z);
+						group.vertex_content.add(normal.x);
+						group.vertex_content.add(normal.y);
+						group.vertex_content.add(normal.z);
+						group.vertex_content.add(uv.x);
+						group.vertex_content.add(uv.y);
+					}
+					if (group.vert_count == 0) {
+						group.min = group.max = vert;
+					} else {
+						if (vert.x < group.min.x) group.min.x = vert.x;
+						if (vert.y < group.min.y) group.min.y = vert.y;
+						if (vert.z < group.min.z) group.min.z = vert.z;
+						if (vert.x > group.max.x) group.max.x = vert.x;
+						if (vert.y > group.max.y) group.max.y = vert.y;
+						if (vert.z > group.max.z) group.max.z = vert.z;
+					}
+					c = corners.size();
+					corners.push_back({norm_idx, uv_idx, group.vert_count, heads[vert_idx]});
+					heads[vert_idx] = c;
+					group.vert_count += 1;
+				}
+				if (hashing) {
+					group.index_content.add((uint32_t)corners[c].out_index);
 				}
-				cur_grp->indices.push_back(index_map[vert_idx]);
+				if (indices != nullptr) {
+					switch (index_size) {
+						case sizeof(uint8_t):
+							((uint8_t*)indices)[group.index_count] = corners[c].out_index;
+							break;
+						case sizeof(uint16_t):
+							((uint16_t*)indices)[group.index_count] = corners[c].out_index;
+							break;
+						default:
+							((uint32_t*)indices)[group.index_count] = corners[c].out_index;
+					}
+				}
+				group.index_count += 1;
 			}
 		}
 	}
 }
 
-template <typename T>
-int addBufferWithViewAndAccessor(GLTF& gltf, std::vector<T>& source) {
-	GLAccessor* accessor;
-	GLBufferView* buffer_view;
-	GLTFBVTarget view_target;
-	GLTFAccType acc_type;
-	GLTFCompType acc_comp_type;
-	int byte_offset;
-	int size = source.size();
-	std::byte* byte_ptr = reinterpret_cast<std::byte*>(source.data());
-	// TODO: may want to split buffer after certain size
-	GLBuffer* buffer = gltf.buffers[0];
-
-	if (std::is_same<T, int>::value) {
-		view_target = GLTFBVTarget::ELEMENT_ARRAY_BUFFER;
-		acc_type = GLTFAccType::SCALAR;
-		acc_comp_type = GLTFCompType::UNSIGNED_INT;
-	} else if (std::is_same<T, Vector3>::value) {
-		view_target = GLTFBVTarget::ARRAY_BUFFER;
-		acc_type = GLTFAccType::VEC3;
-		acc_comp_type = GLTFCompType::FLOAT;
-	}
-
-	byte_offset = buffer->addData(byte_ptr, size * sizeof(T));
-	buffer_view = new GLBufferView(0, byte_offset, size * sizeof(T), 0);
-	buffer_view->target = view_target;
+int addBufferView(GLTF& gltf, int buffer_index, int byte_offset, int byte_length, int byte_stride, GLTFBVTarget target) {
+	GLBufferView* buffer_view = new GLBufferView(buffer_index, byte_offset, byte_length, byte_stride);
+	buffer_view->target = target;
 	gltf.buffer_views.push_back(buffer_view);
+	return gltf.buffer_views.size() - 1;
+}
 
-	accessor = new GLAccessor(acc_type, acc_comp_type);
-	accessor->bufferview_index = gltf.buffer_views.size() - 1;
-	accessor->count = size;
-	getBoundsArray<T>(source.data(), size, accessor->min, accessor->max);
+/// Bounds (min / max) are only allocated when requested, the caller fills them
+int addAccessor(GLTF& gltf, int bufferview_index, int byte_offset, int count, GLTFAccType acc_type, GLTFCompType comp_type, bool bounds) {
+	GLAccessor* accessor;
+	if (bounds) {
+		accessor = new GLAccessor(acc_type, comp_type);
+	} else {
+		accessor = new GLAccessor();
+		accessor->type = acc_type;
+		accessor->component_type = comp_type;
+	}
+	accessor->bufferview_index = bufferview_index;
+	accessor->byte_offset = byte_offset;
+	accessor->count = count;
 	gltf.accessors.push_back(accessor);
-
 	return gltf.accessors.size() - 1;
 }
 
-template <typename T>
-void getBoundsArray(T* values, size_t count, uint32_t* min, uint32_t* max) {
-	if (std::is_same<T, Vector2>::value) {
-		Vector2 vmin, vmax;
-		getBounds<Vector2>((Vector2*)values, count, vmin, vmax);
-		std::memcpy(&min[0], &vmin.x, sizeof(uint32_t));
-		std::memcpy(&min[1], &vmin.y, sizeof(uint32_t));
-		std::memcpy(&max[0], &vmax.x, sizeof(uint32_t));
-		std::memcpy(&max[1], &vmax.y, sizeof(uint32_t));
-	} else if (std::is_same<T, Vector3>::value) {
-		Vector3 vmin, vmax;
-		getBounds<Vector3>((Vector3*)values, count, vmin, vmax);
-		std::memcpy(&min[0], &vmin.x, sizeof(uint32_t));
-		std::memcpy(&min[1], &vmin.y, sizeof(uint32_t));
-		std::memcpy(&min[2], &vmin.z, sizeof(uint32_t));
-		std::memcpy(&max[0], &vmax.x, sizeof(uint32_t));
-		std::memcpy(&max[1], &vmax.y, sizeof(uint32_t));
-		std::memcpy(&max[2], &vmax.z, sizeof(uint32_t));
-	} else if (std::is_same<T, Quaternion>::value) {
-		Quaternion vmin, vmax;
-		getBounds<Quaternion>((Quaternion*)values, count, vmin, vmax);
-		std::memcpy(&min[0], &vmin.x, sizeof(uint32_t));
-		std::memcpy(&min[1], &vmin.y, sizeof(uint32_t));
-		std::memcpy(&min[2], &vmin.z, sizeof(uint32_t));
-		std::memcpy(&min[3], &vmin.w, sizeof(uint32_t));
-		std::memcpy(&max[0], &vmax.x, sizeof(uint32_t));
-		std::memcpy(&max[1], &vmax.y, sizeof(uint32_t));
-		std::memcpy(&max[2], &vmax.z, sizeof(uint32_t));
-		std::memcpy(&max[3], &vmax.w, sizeof(uint32_t));
-	} else {
-		getBounds<T>(values, count, *(T*)min, *(T*)max);
+int addInstanceAccessor(GLTF& gltf, std::vector<float>& source, GLTFAccType type) {
+	int byte_offset;
+	int buffer_index;
+	int view_index;
+	int byte_length = source.size() * sizeof(float);
+
+	byte_offset = gltf.addBlock(byte_length, [values = std::move(source)](std::byte* dest) {
+		std::memcpy(dest, values.data(), values.size() * sizeof(float));
+	}, buffer_index);
+	// Instance attributes are not vertex data, so no buffer view target
+	view_index = addBufferView(gltf, buffer_index, byte_offset, byte_length, 0, GLTFBVTarget::NONE);
+	return addAccessor(
+		gltf, view_index, 0, byte_length / sizeof(float) / GLTFAccTypeToInt(type),
+		type, GLTFCompType::FLOAT, false
+	);
+}
+
+/// Views of one buffer block, generated together
+class GLCompressTask {
+public:
+	int buffer_index;
+	int block_index;
+	std::vector<int> views;
+};
+
+/// Where a view's bytes are in its source block and where they go in the compressed block
+class GLCompressView {
+public:
+	GLTFMeshoptMode mode;
+	int source_offset;
+	int dest_offset;
+	int byte_length;
+	int byte_stride;
+	int count;
+};
+
+/// The encoders are deterministic, so the size measured up front matches the data written later
+void encodeGLTFView(std::vector<uint8_t>& out, const uint8_t* bytes, GLTFMeshoptMode mode, int count, int stride, std::vector<uint32_t>& indices) {
+	out.clear();
+	if (mode == GLTFMeshoptMode::TRIANGLES) {
+		indices.resize(count);
+		for (int i = 0; i < count; i++) {
+			indices[i] = stride == 2 ? ((const uint16_t*)bytes)[i] : ((const uint32_t*)bytes)[i];
+		}
+		meshoptEncodeIndexBuffer(out, indices.data(), count);
+	} else if (mode == GLTFMeshoptMode::ATTRIBUTES) {
+		meshoptEncodeVertexBuffer(out, bytes, count, stride);
+	}
+}
+
+/// Pick a mode for each view of a generated block and measure its encoded size,
+/// views that cannot be (or are not worth) encoded are kept raw. Only sizes are kept.
+void measureGLTFBlock(GLTF& gltf, const GLCompressTask& task, const std::vector<int>& element_sizes, std::vector<int>& encoded_sizes) {
+	int stride, count;
+	GLTFMeshoptMode mode;
+	const GLBufferBlock& block = gltf.buffers[task.buffer_index]->blocks[task.block_index];
+	std::vector<std::byte> raw(block.byte_length, std::byte(0));
+	std::vector<uint8_t> encoded;
+	std::vector<uint32_t> indices;
+
+	block.write(raw.data());
+	for (int v : task.views) {
+		GLBufferView& view = *gltf.buffer_views[v];
+		const uint8_t* bytes = (const uint8_t*)raw.data() + view.byte_offset - block.byte_offset;
+		stride = view.byte_stride != 0 ? view.byte_stride : element_sizes[v];
+		count = stride > 0 ? view.byte_length / stride : 0;
+
+		mode = GLTFMeshoptMode::NONE;
+		if (view.target == GLTFBVTarget::ELEMENT_ARRAY_BUFFER && (stride == 2 || stride == 4) && count % 3 == 0) {
+			mode = GLTFMeshoptMode::TRIANGLES;
+		} else if (view.target != GLTFBVTarget::ELEMENT_ARRAY_BUFFER
+			&& stride > 0 && stride % 4 == 0 && stride <= 256 && view.byte_length % stride == 0
+		) {
+			mode = GLTFMeshoptMode::ATTRIBUTES;
+		}
+		encodeGLTFView(encoded, bytes, mode, count, stride, indices);
+
+		if (mode == GLTFMeshoptMode::NONE || encoded.size() >= view.byte_length) {
+			encoded_sizes[v] = view.byte_length;
+		} else {
+			view.meshopt.mode = mode;
+			view.meshopt.byte_stride = stride;
+			view.meshopt.count = count;
+			encoded_sizes[v] = encoded.size();
+		}
+	}
+}
+
+/// Move buffer data into new compressed buffers (EXT_meshopt_compression), placed first.
+/// The original buffers stay as fallbacks: their layout is what the views decode to.
+/// Nothing changes when no view gets smaller.
+void compressGLTFBuffers(GLTF& gltf) {
+	int i, b, k, dest_offset;
+	int buffer_count = gltf.buffers.size();
+	bool compressed = false;
+	std::vector<int> element_sizes(gltf.buffer_views.size(), 0);
+	std::vector<int> encoded_sizes(gltf.buffer_views.size(), 0);
+	std::vector<GLCompressTask> tasks;
+	std::vector<int> task_index;
+	std::vector<int> block_offsets;
+	std::vector<std::vector<GLBufferBlock>> source_blocks(buffer_count);
+
+	// Tightly packed views are encoded per element
+	for (GLAccessor* accessor : gltf.accessors) {
+		element_sizes[accessor->bufferview_index] = GLTFCompTypeToSize[(int)accessor->component_type]
+			* GLTFAccTypeToInt(accessor->type);
+	}
+
+	// Group views by the block holding them
+	for (b = 0; b < buffer_count; b++) {
+		const std::vector<GLBufferBlock>& blocks = gltf.buffers[b]->blocks;
+		block_offsets.clear();
+		for (const GLBufferBlock& block : blocks) {
+			block_offsets.push_back(block.byte_offset);
+		}
+		task_index.assign(blocks.size(), -1);
+		for (i = 0; i < gltf.buffer_views.size(); i++) {
+			if (gltf.buffer_views[i]->buffer_index != b) continue;
+			k = std::upper_bound(block_offsets.begin(), block_offsets.end(), gltf.buffer_views[i]->byte_offset)
+				- block_offsets.begin() - 1;
+			if (task_index[k] < 0) {
+				task_index[k] = tasks.size();
+				tasks.push_back({b, k, {}});
+			}
+			tasks[task_index[k]].views.push_back(i);
+		}
+	}
+
+	parallelFor(tasks.size(), 16, [&](int start, int end) {
+		for (int t = start; t < end; t++) {
+			measureGLTFBlock(gltf, tasks[t], element_sizes, encoded_sizes);
+		}
+	});
+
+	for (GLBufferView* view : gltf.buffer_views) {
+		if (view->meshopt.mode != GLTFMeshoptMode::NONE) compressed = true;
 	}
+	if (!compressed) return;
+
+	// Compressed buffers first, each in front of its fallback
+	for (b = 0; b < buffer_count; b++) {
+		gltf.buffers[b]->fallback = true;
+		source_blocks[b] = std::move(gltf.buffers[b]->blocks);
+		gltf.buffers[b]->blocks.clear();
+		gltf.buffers.push_back(new GLBuffer());
+	}
+	std::rotate(gltf.buffers.begin(), gltf.buffers.begin() + buffer_count, gltf.buffers.end());
+
+	// One compressed block per source block: regenerated and encoded again while the buffer is
+	// streamed, so encoded data is never held for the whole export
+	for (const GLCompressTask& task : tasks) {
+		const GLBufferBlock& source = source_blocks[task.buffer_index][task.block_index];
+		std::vector<GLCompressView> views;
+		dest_offset = 0;
+		for (int v : task.views) {
+			const GLBufferView& view = *gltf.buffer_views[v];
+			dest_offset = (dest_offset + 3) & ~3;
+			views.push_back({
+				view.meshopt.mode, view.byte_offset - source.byte_offset, dest_offset,
+				view.byte_length, view.meshopt.byte_stride, view.meshopt.count
+			});
+			dest_offset += encoded_sizes[v];
+		}
+
+		b = task.buffer_index;
+		k = gltf.buffers[b]->addBlock(dest_offset, [source, views](std::byte* dest) {
+			std::vector<std::byte> raw(source.byte_length, std::byte(0));
+			std::vector<uint8_t> encoded;
+			std::vector<uint32_t> indices;
+
+			source.write(raw.data());
+			for (const GLCompressView& view : views) {
+				const uint8_t* bytes = (const uint8_t*)raw.data() + view.source_offset;
+				if (view.mode == GLTFMeshoptMode::NONE) {
+					std::memcpy(dest + view.dest_offset, bytes, view.byte_length);
+					continue;
+				}
+				encodeGLTFView(encoded, bytes, view.mode, view.count, view.byte_stride, indices);
+				std::memcpy(dest + view.dest_offset, encoded.data(), encoded.size());
+			}
+		});
+
+		for (i = 0; i < task.views.size(); i++) {
+			GLBufferView& view = *gltf.buffer_views[task.views[i]];
+			if (view.meshopt.mode == GLTFMeshoptMode::NONE) {
+				view.byte_offset = k + views[i].dest_offset;
+			} else {
+				view.meshopt.buffer_index = b;
+				view.meshopt.byte_offset = k + views[i].dest_offset;
+				view.meshopt.byte_length = encoded_sizes[task.views[i]];
+				view.buffer_index = buffer_count + b;
+			}
+		}
+	}
+
+	gltf.extensions_used.push_back("EXT_meshopt_compression");
+	gltf.extensions_required.push_back("EXT_meshopt_compression");
 }
\ No newline at end of file
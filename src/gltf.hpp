@@ -4,7 +4,12 @@
 #ifndef GLTF_H
 #define GLTF_H
 
+#include <string>
 #include <vector>
+#include <ostream>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 
 // Forward declaration to avoid using headers and getting multiple redefines
 class Vector3;
@@ -13,7 +18,8 @@ class Node;
 
 enum class GLTFBVTarget {
 	ARRAY_BUFFER,
-	ELEMENT_ARRAY_BUFFER
+	ELEMENT_ARRAY_BUFFER,
+	NONE
 };
 
 enum class GLTFAlphaMode {
@@ -37,6 +43,12 @@ enum class GLTFCompType {
 	FLOAT
 };
 
+enum class GLTFMeshoptMode {
+	NONE,
+	ATTRIBUTES,
+	TRIANGLES
+};
+
 enum class GLTFTopoTypes {
 	POINTS,
 	LINE_STRIPS,
@@ -47,15 +59,41 @@ enum class GLTFTopoTypes {
 	TIRANGLE_FANS
 };
 
-/// URI and Byte Length auto generated on save
+/// Bytes of one or more buffer views, written once the buffer layout is final
+class GLBufferBlock {
+public:
+	int byte_offset;
+	int byte_length;
+	std::function<void(std::byte* dest)> write;
+};
+
+/// URI auto generated on save.
+/// Only the layout is kept, block data is generated while the file is written.
+/// Fallback buffers (EXT_meshopt_compression) keep their layout but are never written,
+/// their views are decoded from compressed buffers instead.
 class GLBuffer {
 public:
-	// int byte_length;
+	int byte_length;
+	bool fallback;
 	// char uri[128];
-	std::vector<std::byte> data;
+	std::vector<GLBufferBlock> blocks;
+
+	GLBuffer();
+	int addBlock(int size, const std::function<void(std::byte* dest)>& write);
+	void write(std::ostream& f) const;
+};
 
-	GLBuffer() = default;
-	int addData(std::byte* data, int size);
+/// Where a buffer view's EXT_meshopt_compression data is and how to decode it
+class GLMeshopt {
+public:
+	GLTFMeshoptMode mode;
+	int buffer_index;
+	int byte_offset;
+	int byte_length;
+	int byte_stride;
+	int count;
+
+	GLMeshopt();
 };
 
 class GLBufferView {
@@ -65,6 +103,8 @@ public:
 	int byte_length;
 	int byte_stride;
 	GLTFBVTarget target;
+	// Mode NONE if not compressed
+	GLMeshopt meshopt;
 
 	GLBufferView();
 	GLBufferView(int buffer_idx, int offset, int length, int stride);
@@ -77,6 +117,8 @@ public:
 	int count;
 	GLTFAccType type;
 	GLTFCompType component_type;
+	// Integer components map to [0, 1] (unsigned) or [-1, 1] (signed)
+	bool normalized;
 	uint32_t* min;
 	uint32_t* max;
 
@@ -120,22 +162,37 @@ public:
 	GLPrimitive(int indices_idx, int mat_idx, GLTFTopoTypes mode);
 };
 
+/// Quantized meshes (KHR_mesh_quantization) store positions in [0, 1],
+/// nodes using them apply dequant_translation and dequant_scale (nullptr if not quantized)
 class GLMesh {
 public:
 	std::vector<GLPrimitive*> primitives;
+	Vector3* dequant_translation;
+	Vector3* dequant_scale;
+
+	GLMesh();
+	~GLMesh();
 };
 
+/// Translation, scale, and rotation are optional (nullptr is identity)
+/// Translation and scale are only deleted with the node if owns_transform is set
 class GLNode {
 public:
 	Vector3* translation;
 	Vector3* scale;
 	Quaternion* rotation;
+	bool owns_transform;
 	char name[128];
 	std::vector<int> child_indicies;
 	int mesh_index;
+	// EXT_mesh_gpu_instancing attribute accessors (-1 if not instanced)
+	int instance_translation_index;
+	int instance_rotation_index;
+	int instance_scale_index;
 
 	GLNode();
 	GLNode(const char* name, Vector3* position, Vector3* scale, Quaternion* rotation);
+	~GLNode();
 	void addChild(int node_idx);
 };
 
@@ -156,12 +213,28 @@ public:
 	std::vector<GLAccessor*> accessors;
 	std::vector<GLBufferView*> buffer_views;
 	std::vector<GLBuffer*> buffers;
+	std::vector<std::string> extensions_used;
+	std::vector<std::string> extensions_required;
 
 	GLTF();
 	~GLTF();
+	int addBlock(int64_t size, const std::function<void(std::byte* dest)>& write, int& buffer_index);
 	void save(const char* filename, bool single_glb);
+	void saveAsGLTFFallback(const char* filename);
+};
+
+class GLTFOptions {
+public:
+	// EXT_mesh_gpu_instancing for repeated entities
+	bool instancing;
+	// KHR_mesh_quantization
+	bool quantize;
+	// EXT_meshopt_compression
+	bool compress;
+
+	GLTFOptions();
 };
 
-GLTF* createGLTFFromScene(Node& scene);
+GLTF* createGLTFFromScene(Node& scene, const GLTFOptions& options);
 
 #endif // GLTF_H
\ No newline at end of file
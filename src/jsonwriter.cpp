@@ -0,0 +1,176 @@
+#include "jsonwriter.hpp"
+
+#include <charconv>
+#include <cmath>
+#include <cstring>
+
+#include "json.hpp"
+
+// Buffered output is handed to the stream in chunks of about this size
+const size_t JSON_WRITER_CHUNK = 1 << 16;
+
+JsonWriter::JsonWriter(std::ostream& out) : out(out) {
+	this->after_key = false;
+	this->buffer.reserve(JSON_WRITER_CHUNK + 256);
+}
+
+JsonWriter::~JsonWriter() {
+	this->flush();
+}
+
+void JsonWriter::flush() {
+	if (this->buffer.size() == 0) return;
+	this->out.write(this->buffer.data(), this->buffer.size());
+	this->buffer.clear();
+}
+
+void JsonWriter::write(const char* text, size_t length) {
+	this->buffer.append(text, length);
+	if (this->buffer.size() >= JSON_WRITER_CHUNK) this->flush();
+}
+
+void JsonWriter::write(char c) {
+	this->buffer.push_back(c);
+	if (this->buffer.size() >= JSON_WRITER_CHUNK) this->flush();
+}
+
+/// Comma before every entry but the first, none between a key and its value
+void JsonWriter::separate() {
+	if (this->after_key) {
+		this->after_key = false;
+		return;
+	}
+	if (this->empty.size() == 0) return;
+	if (!this->empty.back()) this->write(',');
+	this->empty.back() = false;
+}
+
+void JsonWriter::beginObject() {
+	this->separate();
+	this->write('{');
+	this->empty.push_back(true);
+}
+
+void JsonWriter::endObject() {
+	this->empty.pop_back();
+	this->write('}');
+}
+
+void JsonWriter::beginArray() {
+	this->separate();
+	this->write('[');
+	this->empty.push_back(true);
+}
+
+void JsonWriter::endArray() {
+	this->empty.pop_back();
+	this->write(']');
+}
+
+JsonWriter& JsonWriter::key(const char* name) {
+	this->separate();
+	this->writeString(name, std::strlen(name));
+	this->write(':');
+	this->after_key = true;
+	return *this;
+}
+
+void JsonWriter::value(int number) {
+	char text[16];
+	this->separate();
+	this->write(text, std::to_chars(text, text + sizeof(text), number).ptr - text);
+}
+
+void JsonWriter::value(uint32_t number) {
+	char text[16];
+	this->separate();
+	this->write(text, std::to_chars(text, text + sizeof(text), number).ptr - text);
+}
+
+void JsonWriter::value(uint64_t number) {
+	char text[24];
+	this->separate();
+	this->write(text, std::to_chars(text, text + sizeof(text), number).ptr - text);
+}
+
+void JsonWriter::value(float number) {
+	char text[64];
+	this->separate();
+	// Same as json.hpp: not representable in JSON
+	if (!std::isfinite(number)) {
+		this->write("null", 4);
+		return;
+	}
+	this->write(text, nlohmann::detail::to_chars(text, text + sizeof(text), number) - text);
+}
+
+void JsonWriter::value(bool flag) {
+	this->separate();
+	if (flag) this->write("true", 4);
+	else this->write("false", 5);
+}
+
+void JsonWriter::value(const char* text) {
+	this->separate();
+	this->writeString(text, std::strlen(text));
+}
+
+void JsonWriter::value(const std::string& text) {
+	this->separate();
+	this->writeString(text.data(), text.size());
+}
+
+void JsonWriter::values(const std::vector<int>& numbers) {
+	this->beginArray();
+	for (int number : numbers) {
+		this->value(number);
+	}
+	this->endArray();
+}
+
+void JsonWriter::values(const float* numbers, int count) {
+	this->beginArray();
+	for (int i = 0; i < count; i++) {
+		this->value(numbers[i]);
+	}
+	this->endArray();
+}
+
+void JsonWriter::values(const std::vector<std::string>& texts) {
+	this->beginArray();
+	for (const std::string& text : texts) {
+		this->value(text);
+	}
+	this->endArray();
+}
+
+/// Quoted and escaped, bytes from 0x80 up are passed through as UTF-8
+void JsonWriter::writeString(const char* text, size_t length) {
+	const char hex[] = "0123456789abcdef";
+	char escaped[6] = {'\\', 'u', '0', '0', 0, 0};
+	size_t i, start = 0;
+	unsigned char c;
+
+	this->write('"');
+	for (i = 0; i < length; i++) {
+		c = text[i];
+		if (c >= 0x20 && c != '"' && c != '\\') continue;
+		this->write(text + start, i - start);
+		start = i + 1;
+		switch (c) {
+			case '"': this->write("\\\"", 2); break;
+			case '\\': this->write("\\\\", 2); break;
+			case '\b': this->write("\\b", 2); break;
+			case '\f': this->write("\\f", 2); break;
+			case '\n': this->write("\\n", 2); break;
+			case '\r': this->write("\\r", 2); break;
+			case '\t': this->write("\\t", 2); break;
+			default:
+				escaped[4] = hex[c >> 4];
+				escaped[5] = hex[c & 0xf];
+				this->write(escaped, 6);
+		}
+	}
+	this->write(text + start, length - start);
+	this->write('"');
+}
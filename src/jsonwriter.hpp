@@ -0,0 +1,51 @@
+// Compact JSON written straight to a stream, without building a document first
+#ifndef JSONWRITER_H
+#define JSONWRITER_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/// Keys and values are written in call order, commas are placed automatically.
+/// Output is buffered, call flush (or let the writer go out of scope) before using the stream.
+class JsonWriter {
+public:
+	JsonWriter(std::ostream& out);
+	~JsonWriter();
+
+	void beginObject();
+	void endObject();
+	void beginArray();
+	void endArray();
+	/// Key of the next value within an object
+	JsonWriter& key(const char* name);
+
+	void value(int number);
+	void value(uint32_t number);
+	void value(uint64_t number);
+	/// Shortest text that reads back to the same float
+	void value(float number);
+	void value(bool flag);
+	void value(const char* text);
+	void value(const std::string& text);
+	void values(const std::vector<int>& numbers);
+	void values(const float* numbers, int count);
+	void values(const std::vector<std::string>& texts);
+
+	void flush();
+
+private:
+	std::ostream& out;
+	std::string buffer;
+	// Per open object / array, whether it has no entries yet
+	std::vector<bool> empty;
+	bool after_key;
+
+	void separate();
+	void write(const char* text, size_t length);
+	void write(char c);
+	void writeString(const char* text, size_t length);
+};
+
+#endif // JSONWRITER_H
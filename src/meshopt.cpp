@@ -0,0 +1,321 @@
+#include "meshopt.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+const uint8_t MESHOPT_VERTEX_HEADER = 0xa0;
+const uint8_t MESHOPT_INDEX_HEADER = 0xe1;
+// Vertex bytes are delta encoded in groups of 16, a block holds up to 256 vertices within 8KB
+const int MESHOPT_BYTE_GROUP_SIZE = 16;
+const int MESHOPT_VERTEX_BLOCK_BYTES = 8192;
+const int MESHOPT_VERTEX_BLOCK_MAX = 256;
+// Decoders read ahead, the tail (padding and first vertex) is at least this long
+const int MESHOPT_TAIL_MIN = 32;
+
+// Triangle codes with both vertices in the FIFO or next (4 bit values each), the decoder reads
+// this table back from the end of the stream
+const uint8_t MESHOPT_CODEAUX_TABLE[16] = {
+	0x00, 0x76, 0x87, 0x56, 0x67, 0x78, 0xa9, 0x86,
+	0x65, 0x89, 0x68, 0x98, 0x01, 0x69, 0x00, 0x00
+};
+// Rotations starting a triangle at each of its corners
+const int MESHOPT_TRIANGLE_ORDER[3][3] = {{0, 1, 2}, {1, 2, 0}, {2, 0, 1}};
+
+inline uint8_t zigzag8(uint8_t value) {
+	return ((int8_t)value >> 7) ^ (value << 1);
+}
+
+/// Bytes needed for a group at bits per value, values not fitting below the sentinel
+/// (all bits set) follow the packed values in full
+int measureByteGroup(const uint8_t* group, int bits) {
+	int i;
+	int size;
+	uint8_t sentinel;
+
+	if (bits == 0) {
+		for (i = 0; i < MESHOPT_BYTE_GROUP_SIZE; i++) {
+			if (group[i] != 0) return MESHOPT_BYTE_GROUP_SIZE + 1;
+		}
+		return 0;
+	}
+	if (bits == 8) return MESHOPT_BYTE_GROUP_SIZE;
+
+	size = MESHOPT_BYTE_GROUP_SIZE * bits / 8;
+	sentinel = (1 << bits) - 1;
+	for (i = 0; i < MESHOPT_BYTE_GROUP_SIZE; i++) {
+		if (group[i] >= sentinel) size += 1;
+	}
+	return size;
+}
+
+void encodeByteGroup(std::vector<uint8_t>& out, const uint8_t* group, int bits) {
+	int i, k;
+	int per_byte;
+	uint8_t sentinel;
+	uint8_t packed;
+
+	if (bits == 0) return;
+	if (bits == 8) {
+		out.insert(out.end(), group, group + MESHOPT_BYTE_GROUP_SIZE);
+		return;
+	}
+
+	// Packed high bits first
+	sentinel = (1 << bits) - 1;
+	per_byte = 8 / bits;
+	for (i = 0; i < MESHOPT_BYTE_GROUP_SIZE; i += per_byte) {
+		packed = 0;
+		for (k = 0; k < per_byte; k++) {
+			packed = (packed << bits) | std::min(group[i + k], sentinel);
+		}
+		out.push_back(packed);
+	}
+	for (i = 0; i < MESHOPT_BYTE_GROUP_SIZE; i++) {
+		if (group[i] >= sentinel) out.push_back(group[i]);
+	}
+}
+
+/// Groups of 16 bytes behind a header of 2 bits per group (0, 2, 4, or 8 bits per value)
+void encodeBytes(std::vector<uint8_t>& out, const uint8_t* bytes, int count) {
+	int i, g;
+	int size, best_size, best_log2;
+	int group_count = count / MESHOPT_BYTE_GROUP_SIZE;
+	int header = out.size();
+	const int bits_by_log2[4] = {0, 2, 4, 8};
+
+	out.resize(out.size() + (group_count + 3) / 4, 0);
+	for (g = 0; g < group_count; g++) {
+		const uint8_t* group = bytes + g * MESHOPT_BYTE_GROUP_SIZE;
+		best_log2 = 3;
+		best_size = MESHOPT_BYTE_GROUP_SIZE;
+		for (i = 0; i < 3; i++) {
+			size = measureByteGroup(group, bits_by_log2[i]);
+			if (size < best_size) {
+				best_size = size;
+				best_log2 = i;
+			}
+		}
+		out[header + g / 4] |= best_log2 << ((g % 4) * 2);
+		encodeByteGroup(out, group, bits_by_log2[best_log2]);
+	}
+}
+
+void meshoptEncodeVertexBuffer(std::vector<uint8_t>& out, const uint8_t* vertices, int vertex_count, int vertex_size) {
+	int i, k, start, count, aligned_count;
+	int block_size = std::min(
+		(MESHOPT_VERTEX_BLOCK_BYTES / vertex_size) & ~(MESHOPT_BYTE_GROUP_SIZE - 1),
+		MESHOPT_VERTEX_BLOCK_MAX
+	);
+	uint8_t previous;
+	uint8_t last_vertex[256] = {};
+	uint8_t deltas[MESHOPT_VERTEX_BLOCK_MAX] = {};
+
+	out.push_back(MESHOPT_VERTEX_HEADER);
+	if (vertex_count > 0) std::memcpy(last_vertex, vertices, vertex_size);
+
+	// Each byte of the vertex is encoded as its own stream of zigzag deltas per block
+	for (start = 0; start < vertex_count; start += block_size) {
+		count = std::min(block_size, vertex_count - start);
+		aligned_count = (count + MESHOPT_BYTE_GROUP_SIZE - 1) & ~(MESHOPT_BYTE_GROUP_SIZE - 1);
+		for (k = 0; k < vertex_size; k++) {
+			previous = last_vertex[k];
+			for (i = 0; i < count; i++) {
+				deltas[i] = zigzag8(vertices[(start + i) * vertex_size + k] - previous);
+				previous = vertices[(start + i) * vertex_size + k];
+			}
+			std::fill(deltas + count, deltas + aligned_count, 0);
+			encodeBytes(out, deltas, aligned_count);
+		}
+		std::memcpy(last_vertex, vertices + (start + count - 1) * vertex_size, vertex_size);
+	}
+
+	// Tail: padding then the first vertex, the decoder's starting point for deltas
+	out.resize(out.size() + std::max(MESHOPT_TAIL_MIN - vertex_size, 0), 0);
+	if (vertex_count > 0) {
+		out.insert(out.end(), vertices, vertices + vertex_size);
+	} else {
+		out.resize(out.size() + vertex_size, 0);
+	}
+}
+
+/// Position of index in the 16 entry FIFO counting back from the newest, -1 if absent
+int findVertexFifo(const uint32_t* fifo, int offset, uint32_t index) {
+	for (int i = 0; i < 16; i++) {
+		if (fifo[(offset - 1 - i) & 15] == index) return i;
+	}
+	return -1;
+}
+
+/// Position of an edge of triangle (a, b, c) in the FIFO times 4 plus which edge it is, -1 if absent
+int findEdgeFifo(const uint32_t (*fifo)[2], int offset, uint32_t a, uint32_t b, uint32_t c) {
+	int entry;
+	for (int i = 0; i < 16; i++) {
+		entry = (offset - 1 - i) & 15;
+		if (fifo[entry][0] == a && fifo[entry][1] == b) return (i << 2) | 0;
+		if (fifo[entry][0] == b && fifo[entry][1] == c) return (i << 2) | 1;
+		if (fifo[entry][0] == c && fifo[entry][1] == a) return (i << 2) | 2;
+	}
+	return -1;
+}
+
+void pushVertexFifo(uint32_t* fifo, int& offset, uint32_t index) {
+	fifo[offset] = index;
+	offset = (offset + 1) & 15;
+}
+
+void pushEdgeFifo(uint32_t (*fifo)[2], int& offset, uint32_t a, uint32_t b) {
+	fifo[offset][0] = a;
+	fifo[offset][1] = b;
+	offset = (offset + 1) & 15;
+}
+
+/// Zigzag delta from the last free index as a little endian base 128 varint
+void encodeIndexDelta(std::vector<uint8_t>& out, uint32_t index, uint32_t last) {
+	uint32_t delta = index - last;
+	uint32_t value = (delta << 1) ^ (uint32_t)((int32_t)delta >> 31);
+	do {
+		out.push_back((value & 127) | (value > 127 ? 128 : 0));
+		value >>= 7;
+	} while (value != 0);
+}
+
+int findCodeAux(uint8_t codeaux) {
+	for (int i = 0; i < 16; i++) {
+		if (MESHOPT_CODEAUX_TABLE[i] == codeaux) return i;
+	}
+	return -1;
+}
+
+void meshoptEncodeIndexBuffer(std::vector<uint8_t>& out, const uint32_t* indices, int index_count) {
+	int i;
+	int fer, fe, fea, feb, fec, fb, fc, rotation, codeaux_index;
+	int vertex_offset = 0;
+	int edge_offset = 0;
+	bool reset;
+	uint32_t a, b, c;
+	uint32_t next = 0;
+	uint32_t last = 0;
+	uint8_t codeaux;
+	uint32_t vertex_fifo[16];
+	uint32_t edge_fifo[16][2];
+	// One code byte per triangle, then variable length data
+	std::vector<uint8_t> codes;
+	std::vector<uint8_t> data;
+
+	std::fill(vertex_fifo, vertex_fifo + 16, UINT32_MAX);
+	std::fill(&edge_fifo[0][0], &edge_fifo[0][0] + 32, UINT32_MAX);
+	codes.reserve(index_count / 3);
+
+	for (i = 0; i < index_count; i += 3) {
+		fer = findEdgeFifo(edge_fifo, edge_offset, indices[i], indices[i + 1], indices[i + 2]);
+
+		// Shares an edge with a recent triangle, only the third vertex is new
+		if (fer >= 0 && (fer >> 2) < 15) {
+			const int* order = MESHOPT_TRIANGLE_ORDER[fer & 3];
+			a = indices[i + order[0]];
+			b = indices[i + order[1]];
+			c = indices[i + order[2]];
+
+			fe = fer >> 2;
+			fc = findVertexFifo(vertex_fifo, vertex_offset, c);
+			if (fc >= 1 && fc < 13) {
+				fec = fc;
+			} else if (c == next) {
+				fec = 0;
+				next += 1;
+			} else {
+				fec = 15;
+				// One off from the last free index (strip like sequences)
+				if (c + 1 == last) {
+					fec = 13;
+					last = c;
+				} else if (c == last + 1) {
+					fec = 14;
+					last = c;
+				}
+			}
+			codes.push_back((fe << 4) | fec);
+
+			if (fec == 15) {
+				encodeIndexDelta(data, c, last);
+				last = c;
+			}
+			if (fec == 0 || fec >= 13) pushVertexFifo(vertex_fifo, vertex_offset, c);
+			pushEdgeFifo(edge_fifo, edge_offset, c, b);
+			pushEdgeFifo(edge_fifo, edge_offset, a, c);
+		// New triangle, rotated so a is next where possible
+		} else {
+			rotation = indices[i + 1] == next ? 1 : indices[i + 2] == next ? 2 : 0;
+			const int* order = MESHOPT_TRIANGLE_ORDER[rotation];
+			a = indices[i + order[0]];
+			b = indices[i + order[1]];
+			c = indices[i + order[2]];
+
+			// 0, 1, 2 after the start restarts numbering at 0
+			reset = false;
+			if (a == 0 && b == 1 && c == 2 && next > 0) {
+				reset = true;
+				next = 0;
+				std::fill(vertex_fifo, vertex_fifo + 16, UINT32_MAX);
+			}
+
+			fb = findVertexFifo(vertex_fifo, vertex_offset, b);
+			fc = findVertexFifo(vertex_fifo, vertex_offset, c);
+
+			fea = 15;
+			if (a == next) {
+				fea = 0;
+				next += 1;
+			}
+			// FIFO positions are 1 based here, 0 is next
+			if (fb >= 0 && fb < 14) {
+				feb = fb + 1;
+			} else if (b == next) {
+				feb = 0;
+				next += 1;
+			} else feb = 15;
+			if (fc >= 0 && fc < 14) {
+				fec = fc + 1;
+			} else if (c == next) {
+				fec = 0;
+				next += 1;
+			} else fec = 15;
+
+			codeaux = (feb << 4) | fec;
+			codeaux_index = findCodeAux(codeaux);
+			if (fea == 0 && codeaux_index >= 0 && codeaux_index < 14 && !reset) {
+				codes.push_back((15 << 4) | codeaux_index);
+			} else {
+				codes.push_back((15 << 4) | 14 | fea);
+				data.push_back(codeaux);
+			}
+
+			if (fea == 15) {
+				encodeIndexDelta(data, a, last);
+				last = a;
+			}
+			if (feb == 15) {
+				encodeIndexDelta(data, b, last);
+				last = b;
+			}
+			if (fec == 15) {
+				encodeIndexDelta(data, c, last);
+				last = c;
+			}
+
+			if (fea == 0 || fea == 15) pushVertexFifo(vertex_fifo, vertex_offset, a);
+			if (feb == 0 || feb == 15) pushVertexFifo(vertex_fifo, vertex_offset, b);
+			if (fec == 0 || fec == 15) pushVertexFifo(vertex_fifo, vertex_offset, c);
+			pushEdgeFifo(edge_fifo, edge_offset, b, a);
+			pushEdgeFifo(edge_fifo, edge_offset, c, b);
+			pushEdgeFifo(edge_fifo, edge_offset, a, c);
+		}
+	}
+
+	// Header, codes, data, then the table (doubles as read ahead padding for decoders)
+	out.reserve(out.size() + 1 + codes.size() + data.size() + 16);
+	out.push_back(MESHOPT_INDEX_HEADER);
+	out.insert(out.end(), codes.begin(), codes.end());
+	out.insert(out.end(), data.begin(), data.end());
+	out.insert(out.end(), MESHOPT_CODEAUX_TABLE, MESHOPT_CODEAUX_TABLE + 16);
+}
@@ -0,0 +1,14 @@
+// Encoders for the meshoptimizer bitstreams used by EXT_meshopt_compression
+// Spec: https://github.com/KhronosGroup/glTF/blob/main/extensions/2.0/Vendor/EXT_meshopt_compression/README.md
+#ifndef MESHOPT_H
+#define MESHOPT_H
+
+#include <vector>
+#include <cstdint>
+
+/// ATTRIBUTES mode (version 0), vertex_size must be a multiple of 4 up to 256
+void meshoptEncodeVertexBuffer(std::vector<uint8_t>& out, const uint8_t* vertices, int vertex_count, int vertex_size);
+/// TRIANGLES mode (version 1), index_count must be a multiple of 3
+void meshoptEncodeIndexBuffer(std::vector<uint8_t>& out, const uint32_t* indices, int index_count);
+
+#endif // MESHOPT_H
@@ -1,18 +1,62 @@
 #include "objwavefront.hpp"
 
+#include <exception>
 #include <fstream>
 #include <sstream>
 #include <iomanip>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <charconv>
+#include <string_view>
+#include <unordered_set>
+#include <functional>
 
 #include "utils.hpp"
 #include "config.hpp"
+#include "workpool.hpp"
 
 const int INITIAL_BUFFER = 64;
+// Lines per formatting job when saving, and jobs formatted before each write
+const int SAVE_CHUNK_LINES = 32768;
+const int SAVE_WINDOW_JOBS = 16;
 const char* DEFAULT_NAME = "Unnamed";
-uint32_t NEXT_UL_ID = 1;
+std::atomic<uint32_t> NEXT_UL_ID(1);
 
-std::unordered_map<std::string, ObjWavefront> CACHE_OBJWF_LOAD;
-std::unordered_map<Vector3, ObjWavefront> CACHE_OBJWF_MOD;
+ShardedCache<std::string, ObjWavefront> CACHE_OBJWF_LOAD;
+
+/// Offset geometry identity: source model and offset quantized to OFFSET_QUANTUM
+class ObjOffsetKey {
+public:
+	uint32_t ul_id;
+	int32_t offset[3];
+
+	bool operator==(const ObjOffsetKey& key) const {
+		return this->ul_id == key.ul_id
+			&& this->offset[0] == key.offset[0]
+			&& this->offset[1] == key.offset[1]
+			&& this->offset[2] == key.offset[2];
+	}
+};
+
+namespace std {
+	template <>
+	struct hash<ObjOffsetKey> {
+		size_t operator()(const ObjOffsetKey& key) const {
+			// Multiplicative mix per field, xor-shifted float hashes collide on mirrored offsets
+			uint64_t h = key.ul_id;
+			for (int i = 0; i < 3; i++) {
+				h = (h ^ (uint32_t)key.offset[i]) * 0x9E3779B97F4A7C15ull;
+			}
+			return h ^ (h >> 32);
+		}
+	};
+}
+
+const float OFFSET_QUANTUM = 1.0f / 8192.0f;
+ShardedCache<ObjOffsetKey, ObjWavefront> CACHE_OBJWF_MOD;
+
+MaterialTable material_table;
 
 std::string headerLine() {
 	std::stringstream header;
@@ -21,6 +65,28 @@ std::string headerLine() {
 	return header.str();
 }
 
+// Same output as std::fixed << std::setprecision(6)
+void appendFloat(std::string& out, float value) {
+	char buffer[64];
+	std::to_chars_result result = std::to_chars(buffer, buffer + sizeof(buffer), value, std::chars_format::fixed, 6);
+	out.append(buffer, result.ptr - buffer);
+}
+
+void appendInt(std::string& out, int value) {
+	char buffer[16];
+	std::to_chars_result result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+	out.append(buffer, result.ptr - buffer);
+}
+
+void appendVector(std::string& out, const char* prefix, const Vector3& value) {
+	out += prefix;
+	appendFloat(out, value.x);
+	out += ' ';
+	appendFloat(out, value.y);
+	out += ' ';
+	appendFloat(out, value.z);
+}
+
 Material::Material() {
 	this->illum_model = IllumModel::HIGHLIGHT_ON;
 	this->dissolve = 1.0f;
@@ -38,12 +104,22 @@ Material::Material(const char* name) {
 	this->name = name;
 }
 
-std::string Material::getColorHashString(Vector3 color) {
-	Vector3 expanded = 255 * color;
-	std::string result = hexFromInt(expanded.x)
-					   + hexFromInt(expanded.y)
-					   + hexFromInt(expanded.z);
-	return result;
+uint64_t quantizeUnit(float value, uint64_t max) {
+	if (value <= 0.0f) return 0;
+	if (value >= 1.0f) return max;
+	return (uint64_t)(value * max);
+}
+
+uint64_t quantizeColor(const Vector3& color) {
+	return quantizeUnit(color.x, 0xFF) << 16
+		 | quantizeUnit(color.y, 0xFF) << 8
+		 | quantizeUnit(color.z, 0xFF);
+}
+
+MaterialKey Material::getKey() const {
+	return quantizeColor(this->diffuse) << 40
+		 | quantizeColor(this->emissive) << 16
+		 | quantizeUnit(this->dissolve, 0xFFFF);
 }
 
 std::vector<Material> Material::load(const char* filename) {
@@ -181,6 +257,7 @@ std::vector<Material> Material::load(const char* filename) {
 }
 
 void Material::save(const char* filename, const std::vector<const Material*>& materials) {
+	std::string out;
 	std::ofstream f(filename);
 	if (!f.is_open()) {
 		throw SaveException(
@@ -188,33 +265,25 @@ void Material::save(const char* filename, const std::vector<const Material*>& ma
 		);
 	}
 
-	f << std::fixed << std::setprecision(6);
-	f << headerLine();
-
+	out = headerLine();
 	for (int i=0; i < materials.size(); i++) {
-		f << "\n\nnewmtl " << materials[i]->name;
-		f << "\nKa "
-		 << materials[i]->ambient.x << " "
-		 << materials[i]->ambient.y << " "
-		 << materials[i]->ambient.z;
-		f << "\nKd "
-		 << materials[i]->diffuse.x << " "
-		 << materials[i]->diffuse.y << " "
-		 << materials[i]->diffuse.z;
-		f << "\nKs "
-		 << materials[i]->specular.x << " "
-		 << materials[i]->specular.y << " "
-		 << materials[i]->specular.z;
-		f << "\nKe "
-		 << materials[i]->emissive.x << " "
-		 << materials[i]->emissive.y << " "
-		 << materials[i]->emissive.z;
-		f << "\nNs " << materials[i]->spec_exp;
-		f << "\nNi " << materials[i]->optical_density;
-		f << "\nd " << materials[i]->dissolve;
-		f << "\nillum " << (int)materials[i]->illum_model;
+		out += "\n\nnewmtl ";
+		out += materials[i]->name;
+		appendVector(out, "\nKa ", materials[i]->ambient);
+		appendVector(out, "\nKd ", materials[i]->diffuse);
+		appendVector(out, "\nKs ", materials[i]->specular);
+		appendVector(out, "\nKe ", materials[i]->emissive);
+		out += "\nNs ";
+		appendFloat(out, materials[i]->spec_exp);
+		out += "\nNi ";
+		appendFloat(out, materials[i]->optical_density);
+		out += "\nd ";
+		appendFloat(out, materials[i]->dissolve);
+		out += "\nillum ";
+		appendInt(out, (int)materials[i]->illum_model);
 	}
 
+	f.write(out.data(), out.size());
 	f.close();
 }
 
@@ -233,102 +302,271 @@ bool Material::operator!=(const Material& mat) const {
 	return !(*this == mat);
 }
 
-Surface::~Surface() {
-	this->clear();
+int MaterialTable::intern(const Material& material) {
+	MaterialKey key = material.getKey();
+	auto found = this->index.find(key);
+	if (found != this->index.end()) return found->second;
+	this->materials.push_back(material);
+	this->materials.back().name = "mat_" + std::to_string(this->materials.size() - 1);
+	this->index[key] = this->materials.size() - 1;
+	return this->materials.size() - 1;
+}
+
+void MaterialTable::clear() {
+	this->materials.clear();
+	this->index.clear();
 }
 
-void Surface::clear() {
-	if (this->faces != NULL) free(this->faces);
-	this->face_count = 0;
-	delete this->material_refs;
+/// Remove faces flagged in remove (by face index), material ranges shift with the faces
+int Surface::removeFaces(const std::vector<bool>& remove) {
+	int i, kept, range;
+	std::vector<int> kept_before(this->faces.size() + 1);
+
+	kept = 0;
+	for (i = 0; i < this->faces.size(); i++) {
+		kept_before[i] = kept;
+		if (remove[i]) continue;
+		this->faces[kept] = this->faces[i];
+		kept += 1;
+	}
+	kept_before[this->faces.size()] = kept;
+
+	// Ranges left starting on the same face, the last one wins (as usemtl would)
+	range = 0;
+	for (i = 0; i < this->material_ranges.size(); i++) {
+		MaterialRange& cur = this->material_ranges[i];
+		cur.face_start = kept_before[std::min(cur.face_start, (int)this->faces.size())];
+		if (range > 0 && this->material_ranges[range - 1].face_start == cur.face_start) {
+			range -= 1;
+		}
+		if (range != i) this->material_ranges[range] = std::move(cur);
+		range += 1;
+	}
+	this->material_ranges.resize(range);
+
+	i = this->faces.size() - kept;
+	this->faces.resize(kept);
+	this->faces.shrink_to_fit();
+	return i;
+}
+
+std::shared_ptr<ObjGeometry> ObjGeometry::clone() const {
+	std::shared_ptr<ObjGeometry> copy = std::make_shared<ObjGeometry>();
+	copy->verts = this->verts;
+	copy->norms = this->norms;
+	copy->uvs = this->uvs;
+	copy->surfaces = this->surfaces;
+	return copy;
 }
 
 ObjWavefront::ObjWavefront() {
 	this->ul_id = 0;
 	this->name = DEFAULT_NAME;
-	this->vert_count = 0;
-	this->norm_count = 0;
-	this->uv_count = 0;
-	this->surface_count = 0;
-	this->verts = NULL;
-	this->norms = NULL;
-	this->uvs = NULL;
-	this->surfaces = NULL;
+	this->geometry = std::make_shared<ObjGeometry>();
+}
+
+/// Take a private copy of shared geometry (copy-on-write), no-op if already the only owner
+void ObjWavefront::makeUnique() {
+	if (this->geometry.use_count() <= 1) return;
+	this->geometry = this->geometry->clone();
 }
 
-ObjWavefront::~ObjWavefront() {
-	this->clear();
+int32_t quantizeOffset(float value) {
+	return (int32_t)std::lround(value / OFFSET_QUANTUM);
 }
 
 void ObjWavefront::offset(const Vector3& offset, bool cache) {
 	int i;
 
-	if (cache && CACHE_OBJWF_MOD.find(offset) != CACHE_OBJWF_MOD.end()) {
-		*this = CACHE_OBJWF_MOD[offset];
+	if (cache) {
+		ObjOffsetKey key = {
+			this->ul_id,
+			{quantizeOffset(offset.x), quantizeOffset(offset.y), quantizeOffset(offset.z)}
+		};
+		*this = CACHE_OBJWF_MOD.get(key, [&](ObjWavefront& cached) {
+			cached = *this;
+			cached.offset(offset, false);
+		});
 		return;
 	}
-	this->ul_id = NEXT_UL_ID;
-	NEXT_UL_ID += 1;
-	
-	for (i = 0; i < this->vert_count; i++) {
-		this->verts[i] = offset + this->verts[i];
+	this->ul_id = NEXT_UL_ID++;
+
+	this->makeUnique();
+	std::vector<Vector3>& verts = this->geometry->verts;
+	for (i = 0; i < verts.size(); i++) {
+		verts[i] = offset + verts[i];
 	}
-	CACHE_OBJWF_MOD[offset] = *this;
+}
+
+/// Run of one record type within the file, written to its arrays from record_start on.
+/// Runs are cut every LOAD_CHUNK_RECORDS so large sections parse in parallel.
+class ObjLoadChunk {
+public:
+	ObjReadState state;
+	int surface_index;
+	int record_start;
+	int record_count;
+	int line_start;
+	int error_line;
+	const char* begin;
+	const char* end;
+	// Failure of this chunk, reported together with error_line
+	std::exception_ptr error;
 };
 
+const int LOAD_CHUNK_RECORDS = 16384;
+
+Vector3 parseObjVector3(std::string_view line, const char* error) {
+	std::string_view line_s[4];
+	if (string_split_view(line, ' ', line_s, 4) != 4) throw ParseException(error);
+	return Vector3(
+		string_to_float(line_s[1]),
+		string_to_float(line_s[2]),
+		string_to_float(line_s[3])
+	);
+}
+
+Vector2 parseObjVector2(std::string_view line, const char* error) {
+	std::string_view line_s[4];
+	if (string_split_view(line, ' ', line_s, 4) != 3) throw ParseException(error);
+	return Vector2(
+		string_to_float(line_s[1]),
+		string_to_float(line_s[2])
+	);
+}
+
+void parseObjFace(std::string_view line, Face& face) {
+	std::string_view line_s[4];
+	std::string_view line_s_s[3];
+	if (string_split_view(line, ' ', line_s, 4) != 4) throw ParseException("Invalid face (expected triangle data)");
+	for (int i = 0; i < 3; i++) {
+		if (string_split_view(line_s[i+1], '/', line_s_s, 3) != 3) throw ParseException("Invalid face point (expected 2 slashes '/')");
+		face.vert_index[i] = string_to_int(line_s_s[0]);
+		face.uv_index[i] = line_s_s[1].size() > 0 ? string_to_int(line_s_s[1]) : 0;
+		face.norm_index[i] = string_to_int(line_s_s[2]);
+	}
+}
+
+/// Add record line to the current chunk, or start a new one
+void addObjLoadRecord(std::vector<ObjLoadChunk>& chunks, ObjReadState state, int surface_index, int record_index, std::string_view line, int line_count) {
+	if (chunks.size() == 0
+		|| chunks.back().state != state
+		|| chunks.back().surface_index != surface_index
+		|| chunks.back().record_count == LOAD_CHUNK_RECORDS
+	) {
+		chunks.push_back({state, surface_index, record_index, 0, line_count, 0, line.data(), NULL});
+	}
+	chunks.back().record_count += 1;
+	chunks.back().end = line.data() + line.size();
+}
+
+/// Parse every record of a chunk into its reserved slots.
+/// Lines between records are ones the section already skips (blank, comments, usemtl).
+/// A failure is kept on the chunk instead of thrown, so the earliest one in the file is reported.
+void parseObjLoadChunk(ObjLoadChunk& chunk, ObjGeometry& geometry) {
+	int record = chunk.record_start;
+	int line_count = chunk.line_start - 1;
+	const char* cursor = chunk.begin;
+	const char* line_end;
+	std::string_view line;
+
+	try {
+		while (cursor < chunk.end) {
+			line_end = (const char*)std::memchr(cursor, '\n', chunk.end - cursor);
+			if (line_end == NULL) line_end = chunk.end;
+			line = std::string_view(cursor, line_end - cursor);
+			cursor = line_end + 1;
+			line_count += 1;
+			if (line.size() > 0 && line.back() == '\r') line.remove_suffix(1);
+			if (line.size() <= 2) continue;
+			if (line[0] == '#') continue;
+			switch (chunk.state) {
+			case ObjReadState::VERTICIES:
+				geometry.verts[record++] = parseObjVector3(line, "Invalid vertex");
+				break;
+			case ObjReadState::NORMALS:
+				geometry.norms[record++] = parseObjVector3(line, "Invalid normal");
+				break;
+			case ObjReadState::UVS:
+				geometry.uvs[record++] = parseObjVector2(line, "Invalid UV");
+				break;
+			case ObjReadState::FACES:
+				if (line[0] != 'f') continue;
+				parseObjFace(line, geometry.surfaces[chunk.surface_index].faces[record++]);
+				break;
+			default:
+				break;
+			}
+		}
+	} catch (...) {
+		chunk.error_line = line_count;
+		chunk.error = std::current_exception();
+	}
+}
+
 void ObjWavefront::load(const char* filename, bool cache) {
 	int line_count = 0;
-	int face_count = 0;
-	int current_buffer = INITIAL_BUFFER;
+	int vert_count = 0;
+	int norm_count = 0;
+	int uv_count = 0;
 	ObjReadState state = ObjReadState::OBJECT;
 	Surface* cur_surface = NULL;
-	Vector3* hold_v3;
-	Vector2* hold_v2;
-	Surface* hold_s;
-	Face* hold_f;
+	const char* cursor;
+	const char* line_end;
+	const char* file_end;
 	std::string base_dir;
-	std::string line;
-	// Substring and sub-substring
-	std::vector<std::string> line_s;
-	std::vector<std::string> line_s_s;
+	std::string ref_name;
+	std::string_view line;
+	std::vector<int> face_counts;
 	std::vector<Material> new_materials;
-	std::ifstream f;
+	std::vector<ObjLoadChunk> chunks;
+	std::exception_ptr section_error = nullptr;
+	int section_error_line = 0;
+	MappedFile f;
 
-	try {
-	if (cache && CACHE_OBJWF_LOAD.find(filename) != CACHE_OBJWF_LOAD.end()) {
-		try {
-			*this = CACHE_OBJWF_LOAD[filename];
-		} catch (AllocationException& e) {
-			throw LoadException(
-				"Cache load error \"" + std::string(filename) + "\": " + e.what()
-			);
-		}
+	// Parsed once per file, concurrent loads of the same file wait for it
+	if (cache) {
+		*this = CACHE_OBJWF_LOAD.get(filename, [&](ObjWavefront& parsed) {
+			parsed.load(filename, false);
+		});
 		return;
 	}
-	this->ul_id = NEXT_UL_ID;
-	NEXT_UL_ID += 1;
+
+	this->geometry = std::make_shared<ObjGeometry>();
+	ObjGeometry& geometry = *this->geometry;
+
+	try {
+	this->ul_id = NEXT_UL_ID++;
 
 	base_dir = f_base_dir(filename);
-	f = std::ifstream(filename);
-	if (!f.is_open()) {
+	if (!f.open(filename)) {
 		throw LoadException(
 			"Cannot open Obj Wavefront file \"" + std::string(filename) + "\""
 		);
 	}
 
-	this->verts = (Vector3*)malloc(sizeof(Vector3) * current_buffer);
-	if (this->verts == NULL) throw AllocationException("vertices", current_buffer);
-
-	while (std::getline(f, line)) {
+	// Walk sections and materials in order, records are only located here.
+	// A section error is held until the records located before it are parsed,
+	// so an earlier bad record is still reported first.
+	cursor = f.data;
+	file_end = f.data + f.size;
+	try {
+	while (cursor < file_end) {
+		line_end = (const char*)std::memchr(cursor, '\n', file_end - cursor);
+		if (line_end == NULL) line_end = file_end;
+		line = std::string_view(cursor, line_end - cursor);
+		cursor = line_end + 1;
 		line_count += 1;
+		// CRLF files read the same as through a text mode stream
+		if (line.size() > 0 && line.back() == '\r') line.remove_suffix(1);
 		if (line.size() <= 2) continue;
 		if (line[0] == '#') continue;
 		// Material Library
-		if (state == ObjReadState::OBJECT && line.rfind("mtllib ", 0) == 0) {
+		if (state == ObjReadState::OBJECT && line.substr(0, 7) == "mtllib ") {
 			line = line.substr(7, line.size() - 7);
 			if (line.size() == 0) throw ParseException("Invalid material library");
 			
-			new_materials = Material::load((base_dir + line).c_str());
+			new_materials = Material::load((base_dir + std::string(line)).c_str());
 			for (int i = 0; i < new_materials.size(); i++) {
 				this->materials[new_materials[i].name] = new_materials[i];
 			}
@@ -336,151 +574,106 @@ void ObjWavefront::load(const char* filename, bool cache) {
 		}
 		// Object
 		if (state == ObjReadState::OBJECT && line[0] == 'o' && line[1] == ' ') {
-			this->name = line.substr(2, line.length() - 2);
+			this->name = std::string(line.substr(2, line.length() - 2));
 			state = ObjReadState::VERTICIES;
 			continue;
 		}
 		// Verticies
 		if (state == ObjReadState::VERTICIES) {
 			if (line[0] == 'v' && line[1] == ' ') {
-				line_s = string_split(line, ' ');
-				if (line_s.size() != 4) throw ParseException("Invalid vertex");
-				if (this->vert_count == current_buffer) {
-					current_buffer *= 2;
-					hold_v3 = (Vector3*)realloc(this->verts, sizeof(Vector3) * current_buffer);
-					if (hold_v3 == NULL) throw ReallocException("verticies", current_buffer);
-					this->verts = hold_v3;
-				}
-				this->verts[this->vert_count].x = std::stof(line_s[1]);
-				this->verts[this->vert_count].y = std::stof(line_s[2]);
-				this->verts[this->vert_count].z = std::stof(line_s[3]);
-				this->vert_count += 1;
+				addObjLoadRecord(chunks, state, -1, vert_count, line, line_count);
+				vert_count += 1;
 				continue;
 			} else {
 				state = ObjReadState::NORMALS;
-				if (this->vert_count == 0) throw ParseException("No vertex data found");
-				hold_v3 = (Vector3*)realloc(this->verts, sizeof(Vector3) * this->vert_count);
-				if (hold_v3 == NULL) throw ReallocException("verticies", this->vert_count);
-				this->verts = hold_v3;
-				current_buffer = INITIAL_BUFFER;
-				this->norms = (Vector3*)malloc(sizeof(Vector3) * current_buffer);
-				if (this->norms == NULL) throw AllocationException("normals", current_buffer);
+				if (vert_count == 0) throw ParseException("No vertex data found");
 			}
 		}
 		// Normals
 		if (state == ObjReadState::NORMALS) {
 			if (line[0] == 'v' && line[1] == 'n') {
-				line_s = string_split(line, ' ');
-				if (line_s.size() != 4) throw ParseException("Invalid normal");
-				if (this->norm_count == current_buffer) {
-					current_buffer *= 2;
-					hold_v3 = (Vector3*)realloc(this->norms, sizeof(Vector3) * current_buffer);
-					if (hold_v3 == NULL) throw ReallocException("normals", current_buffer);
-					this->norms = hold_v3;
-				}
-				this->norms[this->norm_count].x = std::stof(line_s[1]);
-				this->norms[this->norm_count].y = std::stof(line_s[2]);
-				this->norms[this->norm_count].z = std::stof(line_s[3]);
-				this->norm_count += 1;
+				addObjLoadRecord(chunks, state, -1, norm_count, line, line_count);
+				norm_count += 1;
 				continue;
 			} else {
 				state = ObjReadState::UVS;
-				if (this->norm_count == 0) throw ParseException("No normal data found");
-				hold_v3 = (Vector3*)realloc(this->norms, sizeof(Vector3) * this->norm_count);
-				if (hold_v3 == NULL) throw ReallocException("normals", this->norm_count);
-				this->norms = hold_v3;
-				current_buffer = INITIAL_BUFFER;
-				this->uvs = (Vector2*)malloc(sizeof(Vector2) * current_buffer);
-				if (this->uvs == NULL) throw AllocationException("UVs", current_buffer);
+				if (norm_count == 0) throw ParseException("No normal data found");
 			}
 		}
 		// UVs
 		if (state == ObjReadState::UVS) {
 			if (line[0] == 'v' && line[1] == 't') {
-				line_s = string_split(line, ' ');
-				if (line_s.size() != 3) throw ParseException("Invalid UV");
-				if (this->uv_count == current_buffer) {
-					current_buffer *= 2;
-					hold_v2 = (Vector2*)realloc(this->uvs, sizeof(Vector2) * current_buffer);
-					if (hold_v2 == NULL) throw ReallocException("UVs", current_buffer);
-					this->uvs = hold_v2;
-				}
-				this->uvs[this->uv_count].x = std::stof(line_s[1]);
-				this->uvs[this->uv_count].y = std::stof(line_s[2]);
-				this->uv_count += 1;
+				addObjLoadRecord(chunks, state, -1, uv_count, line, line_count);
+				uv_count += 1;
 				continue;
 			} else {
 				state = ObjReadState::SURFACES;
-				if (this->uv_count > 0) {
-					hold_v2 = (Vector2*)realloc(this->uvs, sizeof(Vector2) * this->uv_count);
-					if (hold_v2 == NULL) throw ReallocException("UVs", this->uv_count);
-					this->uvs = hold_v2;
-				} else std::free(this->uvs);
-				current_buffer = INITIAL_BUFFER;
-				this->surfaces = (Surface*)malloc(sizeof(Surface) * current_buffer);
-				if (this->surfaces == NULL) throw AllocationException("surfaces", current_buffer);
 			}
 		}
 		// Surfaces
 		if (state >= ObjReadState::SURFACES) {
 			if (state == ObjReadState::SURFACES && line[0] == 's') {
-				if (this->surface_count == current_buffer) {
-					hold_s = (Surface*)realloc(this->surfaces, sizeof(Surface) * current_buffer);
-					if (hold_s == NULL) throw ReallocException("surfaces", current_buffer);
-					this->surfaces = hold_s;
-				}
-				cur_surface = &this->surfaces[this->surface_count];
-				cur_surface->face_count = 0;
-				cur_surface->faces = (Face*)malloc(sizeof(Face) * current_buffer);
-				if (cur_surface->faces == NULL) throw AllocationException("surface faces", current_buffer);
-				cur_surface->material_refs = new std::unordered_map<int, std::string>();
-				this->surface_count += 1;
-				face_count = 0;
+				cur_surface = &geometry.surfaces.emplace_back();
+				face_counts.push_back(0);
 				state = ObjReadState::FACES;
 				continue;
 			}
 			// Material Reference
-			if (state == ObjReadState::FACES && line.rfind("usemtl ", 0) == 0) {
+			if (state == ObjReadState::FACES && line.substr(0, 7) == "usemtl ") {
 				line = line.substr(7, line.size() - 7);
 				if (line.size() == 0) throw ParseException("Invalid material reference");
-				line = string_replace(line, " ", "_");
-				if (this->materials.find(line) == this->materials.end()) {
+				ref_name = string_replace(std::string(line), " ", "_");
+				if (this->materials.find(ref_name) == this->materials.end()) {
 					throw ParseException(
 						"Invalid material reference (\""
-						+ line + "\" not loaded)"
+						+ ref_name + "\" not loaded)"
 					);
 				}
-				(*cur_surface->material_refs)[face_count] = line;
+				// Back to back references, the last one applies
+				if (cur_surface->material_ranges.size() > 0
+					&& cur_surface->material_ranges.back().face_start == face_counts.back()
+				) {
+					cur_surface->material_ranges.back().name = ref_name;
+				} else {
+					cur_surface->material_ranges.push_back({face_counts.back(), ref_name});
+				}
 				continue;
 			}
 			// Faces
 			if (state == ObjReadState::FACES && line[0] == 'f') {
-				line_s = string_split(line, ' ');
-				if (line_s.size() != 4) throw ParseException("Invalid face (expected triangle data)");
-				if (face_count == current_buffer) {
-					current_buffer *= 2;
-					hold_f = (Face*)realloc(cur_surface->faces, sizeof(Face) * current_buffer);
-					if (hold_f == NULL) throw ReallocException("surface faces", current_buffer);
-					cur_surface->faces = hold_f;
-				}
-				for (int i = 0; i < 3; i++) {
-					line_s_s = string_split(line_s[i+1], '/');
-					if (line_s_s.size() != 3) throw ParseException("Invalid face point (expected 2 slashes '/')");
-					cur_surface->faces[face_count].vert_index[i] = std::stoi(line_s_s[0]);
-					if (line_s_s[1].size() > 0) cur_surface->faces[face_count].uv_index[i] = std::stoi(line_s_s[1]);
-					cur_surface->faces[face_count].norm_index[i] = std::stoi(line_s_s[2]);
-				}
-				face_count += 1;
+				addObjLoadRecord(chunks, state, geometry.surfaces.size() - 1, face_counts.back(), line, line_count);
+				face_counts.back() += 1;
 			} else {
 				state = ObjReadState::SURFACES;
-				hold_f = (Face*)realloc(cur_surface->faces, sizeof(Face) * face_count);
-				if (hold_f == NULL) throw ReallocException("surface faces", face_count);
-				cur_surface->faces = hold_f;
-				cur_surface->face_count = face_count;
-				current_buffer = INITIAL_BUFFER;
 			}
 		}
 	}
+	} catch (ParseException&) {
+		section_error = std::current_exception();
+		section_error_line = line_count;
+	}
+
+	// Allocate once at final size, then fill the located records in parallel
+	geometry.verts.resize(vert_count);
+	geometry.norms.resize(norm_count);
+	geometry.uvs.resize(uv_count);
+	for (int i = 0; i < geometry.surfaces.size(); i++) {
+		geometry.surfaces[i].faces.resize(face_counts[i]);
+	}
+	parallelFor(chunks.size(), 1, [&](int start, int end) {
+		for (int i = start; i < end; i++) {
+			parseObjLoadChunk(chunks[i], geometry);
+		}
+	});
+	for (const ObjLoadChunk& chunk : chunks) {
+		if (chunk.error == nullptr) continue;
+		line_count = chunk.error_line;
+		std::rethrow_exception(chunk.error);
+	}
+	if (section_error != nullptr) {
+		line_count = section_error_line;
+		std::rethrow_exception(section_error);
+	}
 	} catch (std::invalid_argument) {
 		f.close();
 		this->clear();
@@ -495,11 +688,12 @@ void ObjWavefront::load(const char* filename, bool cache) {
 			"Invalid argument range at line (" + std::to_string(line_count)
 			+ ") in file \"" + filename + "\""
 		);
-	} catch (AllocationException& e) {
+	} catch (std::bad_alloc) {
 		f.close();
 		this->clear();
 		throw LoadException(
-			std::string(e.what()) + " while loading file \"" + filename + "\""
+			"Out of memory at line (" + std::to_string(line_count)
+			+ ") in file \"" + filename + "\""
 		);
 	} catch (ParseException& e) {
 		f.close();
@@ -514,45 +708,177 @@ void ObjWavefront::load(const char* filename, bool cache) {
 	}
 
 	f.close();
+	geometry.surfaces.shrink_to_fit();
+}
+
+enum class ObjSaveJobType {
+	TEXT,
+	VERTS,
+	NORMS,
+	UVS,
+	FACES
+};
 
-	// Finish Face
-	if (state == ObjReadState::FACES && cur_surface != NULL) {
-		state = ObjReadState::SURFACES;
-		hold_f = (Face*)realloc(cur_surface->faces, sizeof(Face) * face_count);
-		if (hold_f == NULL) {
-			this->clear();
-			throw LoadException(
-				"Unable to reallocate memory (" + std::to_string(face_count)
-				+ ") for final faces of final surface "
-				+ std::to_string(this->surface_count - 1)
-			 	+ " while loading file " + filename
-			);
+/// A run of lines to format, jobs are formatted in parallel and written in order
+class ObjSaveJob {
+public:
+	ObjSaveJobType type;
+	int surface_index;
+	int start;
+	int end;
+	std::string out;
+};
+
+/// Material switch within a surface (usemtl before face_index)
+class ObjSaveSwitch {
+public:
+	int face_index;
+	const std::string* material_name;
+};
+
+/// Added to face indices of an object written after others in the same file
+class ObjSaveOffsets {
+public:
+	int vert;
+	int norm;
+	int uv;
+};
+
+void formatObjSaveJob(
+	const ObjGeometry& geometry,
+	const std::vector<std::vector<ObjSaveSwitch>>& switches,
+	const ObjSaveOffsets& offsets,
+	ObjSaveJob& job
+) {
+	int i, k;
+	const Face* face;
+
+	switch (job.type) {
+	case ObjSaveJobType::VERTS:
+		for (i = job.start; i < job.end; i++) {
+			appendVector(job.out, "\nv ", geometry.verts[i]);
+		}
+		break;
+	case ObjSaveJobType::NORMS:
+		for (i = job.start; i < job.end; i++) {
+			appendVector(job.out, "\nvn ", geometry.norms[i]);
 		}
-		cur_surface->faces = hold_f;
-		cur_surface->face_count = face_count;
-	}
-
-	// Finish Surface
-	if (state == ObjReadState::SURFACES) {
-		hold_s = (Surface*)realloc(this->surfaces, sizeof(Surface) * this->surface_count);
-		if (hold_s == NULL) {
-			this->clear();
-			throw LoadException(
-				"Unable to reallocate memory (" + std::to_string(this->surface_count)
-				+ ") for surfaces while loading file " + filename
-			);
+		break;
+	case ObjSaveJobType::UVS:
+		for (i = job.start; i < job.end; i++) {
+			job.out += "\nvt ";
+			appendFloat(job.out, geometry.uvs[i].x);
+			job.out += ' ';
+			appendFloat(job.out, geometry.uvs[i].y);
 		}
-		this->surfaces = hold_s;
+		break;
+	case ObjSaveJobType::FACES: {
+		const std::vector<ObjSaveSwitch>& surface_switches = switches[job.surface_index];
+		auto next = std::lower_bound(
+			surface_switches.begin(), surface_switches.end(), job.start,
+			[](const ObjSaveSwitch& item, int face_index) { return item.face_index < face_index; }
+		);
+		for (i = job.start; i < job.end; i++) {
+			// Material Reference
+			if (next != surface_switches.end() && next->face_index == i) {
+				job.out += "\nusemtl ";
+				job.out += *next->material_name;
+				next++;
+			}
+			job.out += "\nf";  // Note: space moved to forward of face data in loop
+			face = &geometry.surfaces[job.surface_index].faces[i];
+			for (k = 0; k < 3; k++) {
+				job.out += ' ';
+				appendInt(job.out, face->vert_index[k] + offsets.vert);
+				job.out += '/';
+				if (geometry.uvs.size() != 0) {
+					appendInt(job.out, face->uv_index[k] + offsets.uv);
+				}
+				job.out += '/';
+				appendInt(job.out, face->norm_index[k] + offsets.norm);
+			}
+		}
+		break;
 	}
+	case ObjSaveJobType::TEXT:
+		break;
+	}
+}
 
-	if (cache) {
-		if (CACHE_OBJWF_LOAD.find(filename) == CACHE_OBJWF_LOAD.end()) {
-			try {
-				CACHE_OBJWF_LOAD[filename] = *this;
-			} catch (AllocationException& e) {
-				this->clear();
-				throw LoadException("Failed to copy into cache: " + std::string(e.what()));
+void addObjSaveJobs(std::vector<ObjSaveJob>& jobs, ObjSaveJobType type, int surface_index, int count) {
+	for (int start = 0; start < count; start += SAVE_CHUNK_LINES) {
+		jobs.emplace_back();
+		jobs.back().type = type;
+		jobs.back().surface_index = surface_index;
+		jobs.back().start = start;
+		jobs.back().end = std::min(start + SAVE_CHUNK_LINES, count);
+	}
+}
+
+void addObjSaveText(std::vector<ObjSaveJob>& jobs, const std::string& text) {
+	jobs.emplace_back();
+	jobs.back().type = ObjSaveJobType::TEXT;
+	jobs.back().start = 0;
+	jobs.back().end = 0;
+	jobs.back().out = text;
+}
+
+/// Queue the geometry lines of an object (after any leading text already in jobs)
+void addObjSaveGeometry(std::vector<ObjSaveJob>& jobs, const ObjGeometry& geometry) {
+	addObjSaveJobs(jobs, ObjSaveJobType::VERTS, 0, geometry.verts.size());
+	addObjSaveJobs(jobs, ObjSaveJobType::NORMS, 0, geometry.norms.size());
+	addObjSaveJobs(jobs, ObjSaveJobType::UVS, 0, geometry.uvs.size());
+	for (int i = 0; i < geometry.surfaces.size(); i++) {
+		addObjSaveText(jobs, "\ns " + std::to_string(i));
+		addObjSaveJobs(jobs, ObjSaveJobType::FACES, i, geometry.surfaces[i].faces.size());
+	}
+}
+
+/// Material switch points per surface, name_of gives the written name or NULL to skip the material
+void addObjSaveSwitches(
+	const ObjGeometry& geometry,
+	std::vector<std::vector<ObjSaveSwitch>>& switches,
+	const std::function<const std::string*(const std::string&)>& name_of
+) {
+	const std::string* name;
+
+	switches.resize(geometry.surfaces.size());
+	for (int i = 0; i < geometry.surfaces.size(); i++) {
+		const Surface& surface = geometry.surfaces[i];
+		for (const MaterialRange& range : surface.material_ranges) {
+			if (range.face_start < 0 || range.face_start >= surface.faces.size()) continue;
+			name = name_of(range.name);
+			if (name == NULL) continue;
+			switches[i].push_back({range.face_start, name});
+		}
+	}
+}
+
+/// Format a window of jobs in parallel, then write it in order
+void writeObjSaveJobs(
+	std::ofstream& f,
+	const ObjGeometry& geometry,
+	const std::vector<std::vector<ObjSaveSwitch>>& switches,
+	const ObjSaveOffsets& offsets,
+	std::vector<ObjSaveJob>& jobs
+) {
+	int i, window, lines;
+
+	for (window = 0; window < jobs.size(); window += SAVE_WINDOW_JOBS) {
+		int window_end = std::min(window + SAVE_WINDOW_JOBS, (int)jobs.size());
+		// Small objects are formatted inline, not worth starting threads
+		lines = 0;
+		for (i = window; i < window_end; i++) {
+			lines += jobs[i].end - jobs[i].start;
+		}
+		parallelFor(window_end - window, lines < SAVE_CHUNK_LINES ? window_end - window : 1, [&](int start, int end) {
+			for (int n = window + start; n < window + end; n++) {
+				formatObjSaveJob(geometry, switches, offsets, jobs[n]);
 			}
+		});
+		for (i = window; i < window_end; i++) {
+			f.write(jobs[i].out.data(), jobs[i].out.size());
+			jobs[i].out = std::string();
 		}
 	}
 }
@@ -563,16 +889,18 @@ void ObjWavefront::save(const char* filename) const {
 	std::string mat_filename;
 	std::vector<std::string>::iterator check;
 	std::vector<std::string> unique_mats;
-	std::vector<std::string> orphan_mats;
+	std::unordered_set<std::string> orphan_mats;
 	std::vector<const Material*> materials_flat;
+	std::vector<std::vector<ObjSaveSwitch>> switches;
+	std::vector<ObjSaveJob> jobs;
 
 	// Save Material Library
-	for (i = 0; i < this->surface_count; i++) {
-		if (this->surfaces[i].face_count == 0) continue;
-		for (std::pair<int, std::string> kv : (*this->surfaces[i].material_refs)) {
-			check = std::find(unique_mats.begin(), unique_mats.end(), kv.second);
+	for (const Surface& surface : this->geometry->surfaces) {
+		if (surface.faces.size() == 0) continue;
+		for (const MaterialRange& range : surface.material_ranges) {
+			check = std::find(unique_mats.begin(), unique_mats.end(), range.name);
 			if (check != unique_mats.end()) continue;
-			unique_mats.push_back(kv.second);
+			unique_mats.push_back(range.name);
 		}
 	}
 	if (unique_mats.size() > 0) {
@@ -582,7 +910,7 @@ void ObjWavefront::save(const char* filename) const {
 			if (this->materials.find(unique_mats[i]) != this->materials.end()) {
 				materials_flat.push_back(&this->materials.at(unique_mats[i]));
 			} else {
-				orphan_mats.push_back(unique_mats[i]);
+				orphan_mats.insert(unique_mats[i]);
 			}
 		}
 		if (materials_flat.size() > 0) {
@@ -592,90 +920,116 @@ void ObjWavefront::save(const char* filename) const {
 		materials_flat.clear();
 	}
 
+	// Orphan materials are not referenced
+	addObjSaveSwitches(*this->geometry, switches, [&](const std::string& name) -> const std::string* {
+		if (orphan_mats.find(name) != orphan_mats.end()) return NULL;
+		return &name;
+	});
+
 	std::ofstream f(filename);
 	if (!f.is_open()) {
-		throw SaveException(std::strcat("Cannot open file for writing ", filename));
+		throw SaveException(
+			"Cannot open file for writing \"" + std::string(filename) + "\""
+		);
 	}
 
-	f << std::fixed << std::setprecision(6);
-	f << headerLine();
+	// Header, Material Library, and Object
+	addObjSaveText(jobs, headerLine()
+		+ (mat_filename.size() > 0 ? "\nmtllib " + mat_filename : "")
+		+ "\no " + this->name
+	);
+	addObjSaveGeometry(jobs, *this->geometry);
+	writeObjSaveJobs(f, *this->geometry, switches, {0, 0, 0}, jobs);
 
-	// Material Library
-	if (mat_filename.size() > 0) {
-		f << "\nmtllib " << mat_filename;
-	}
+	f.close();
+}
 
-	// Object
-	f << "\no " << this->name;
+ObjStreamWriter::ObjStreamWriter() {
+	this->vert_offset = 0;
+	this->norm_offset = 0;
+	this->uv_offset = 0;
+}
 
-	// Vectors
-	for (i = 0; i < this->vert_count; i++) {
-		f << "\nv "
-		 << this->verts[i].x << " "
-		 << this->verts[i].y << " "
-		 << this->verts[i].z;
-	}
-	// Normals
-	for (i = 0; i < this->norm_count; i++) {
-		f << "\nvn "
-		 << this->norms[i].x << " "
-		 << this->norms[i].y << " "
-		 << this->norms[i].z;
-	}
-	// UVs
-	for (i = 0; i < this->uv_count; i++) {
-		f << "\nvt "
-		 << this->uvs[i].x << " "
-		 << this->uvs[i].y;
+void ObjStreamWriter::open(const char* filename) {
+	std::string header;
+
+	this->base_dir = f_base_dir(filename);
+	this->mat_filename = f_base_filename_no_ext(filename) + ".mtl";
+	this->file.open(filename);
+	if (!this->file.is_open()) {
+		throw SaveException(
+			"Cannot open file for writing \"" + std::string(filename) + "\""
+		);
 	}
-	// Surfaces
-	for (i = 0; i < this->surface_count; i++) {
-		f << "\ns " << i;
-		// Faces
-		for (int j = 0; j < this->surfaces[i].face_count; j++) {
-			// Material Reference
-			// If face index is in material reference and material reference is not in ophan materials
-			if (this->surfaces[i].material_refs->find(j)
-				!= this->surfaces[i].material_refs->end() &&
-				std::find(
-					orphan_mats.begin(),
-					orphan_mats.end(),
-					(*this->surfaces[i].material_refs)[j]
-				)
-				== orphan_mats.end()
-			) {
-				f << "\nusemtl " << (*this->surfaces[i].material_refs)[j];
-			}
 
-			f << "\nf";  // Note: space moved to forward of face data in loop
-			for (int k = 0; k < 3; k++) {
-				f << " " << this->surfaces[i].faces[j].vert_index[k] << "/";
-				if (this->uv_count != 0) {
-					f << this->surfaces[i].faces[j].uv_index[k];
-				}
-				f << "/" << this->surfaces[i].faces[j].norm_index[k];
+	// Material library is written on close, once every material is known
+	header = headerLine() + "\nmtllib " + this->mat_filename;
+	this->file.write(header.data(), header.size());
+}
+
+void ObjStreamWriter::write(const ObjWavefront& obj, const std::string& object_name, const std::string& group_name) {
+	const ObjGeometry& geometry = *obj.geometry;
+	std::unordered_map<std::string, int> mat_indices;
+	std::vector<std::vector<ObjSaveSwitch>> switches;
+	std::vector<ObjSaveJob> jobs;
+
+	// Intern materials first, table names are stable once no more are added
+	for (const Surface& surface : geometry.surfaces) {
+		if (surface.faces.size() == 0) continue;
+		for (const MaterialRange& range : surface.material_ranges) {
+			if (mat_indices.find(range.name) != mat_indices.end()) continue;
+			auto found = obj.materials.find(range.name);
+			if (found == obj.materials.end()) continue;
+			mat_indices[range.name] = material_table.intern(found->second);
+			if (this->material_used.insert(mat_indices[range.name]).second) {
+				this->material_indices.push_back(mat_indices[range.name]);
 			}
 		}
 	}
+	addObjSaveSwitches(geometry, switches, [&](const std::string& name) -> const std::string* {
+		auto found = mat_indices.find(name);
+		if (found == mat_indices.end()) return NULL;
+		return &material_table.materials[found->second].name;
+	});
 
-	f.close();
+	// Spaces separate group names in OBJ, same replacement as the loader
+	addObjSaveText(jobs, "\no " + string_replace(object_name, " ", "_")
+		+ (group_name.size() > 0 ? "\ng " + string_replace(group_name, " ", "_") : "")
+	);
+	addObjSaveGeometry(jobs, geometry);
+	writeObjSaveJobs(this->file, geometry, switches, {this->vert_offset, this->norm_offset, this->uv_offset}, jobs);
+
+	this->vert_offset += geometry.verts.size();
+	this->norm_offset += geometry.norms.size();
+	this->uv_offset += geometry.uvs.size();
+}
+
+void ObjStreamWriter::close() {
+	std::vector<const Material*> materials_flat;
+
+	this->file.close();
+	for (int i = 0; i < this->material_indices.size(); i++) {
+		materials_flat.push_back(&material_table.materials[this->material_indices[i]]);
+	}
+	Material::save((this->base_dir + this->mat_filename).c_str(), materials_flat);
 }
 
 std::vector<Material*> ObjWavefront::getSurfaceMaterials(int surface_index) {
 	std::vector<Material*> mats;
 	std::vector<std::string> unique_mats;
 
-	if (surface_index < 0 || surface_index >= this->surface_count) return mats;
+	if (surface_index < 0 || surface_index >= this->geometry->surfaces.size()) return mats;
 
-	for (std::pair<int, std::string> kv : (*this->surfaces[surface_index].material_refs)) {
+	// Ranges are in face order, so the first material is the one the surface starts with
+	for (const MaterialRange& range : this->geometry->surfaces[surface_index].material_ranges) {
 		if (std::find(
 				unique_mats.begin(),
 				unique_mats.end(),
-				kv.second
+				range.name
 			)
 			!= unique_mats.end()
 		) continue;
-		unique_mats.push_back(kv.second);
+		unique_mats.push_back(range.name);
 	}
 
 	for (int i = 0; i < unique_mats.size(); i++) {
@@ -687,7 +1041,8 @@ std::vector<Material*> ObjWavefront::getSurfaceMaterials(int surface_index) {
 }
 
 void ObjWavefront::setSurfaceMaterial(int surface_index, Material& material) {
-	if (surface_index < 0 || surface_index >= this->surface_count) return;
+	if (surface_index < 0 || surface_index >= this->geometry->surfaces.size()) return;
+	this->makeUnique();
 
 	if (this->materials.find(material.name) == this->materials.end()) {
 		this->materials[material.name] = material;
@@ -703,104 +1058,48 @@ void ObjWavefront::setSurfaceMaterial(int surface_index, Material& material) {
 		}
 	}
 
-	this->surfaces[surface_index].material_refs->clear();
-	(*this->surfaces[surface_index].material_refs)[0] = material.name;
+	std::vector<MaterialRange>& ranges = this->geometry->surfaces[surface_index].material_ranges;
+	ranges.clear();
+	ranges.push_back({0, material.name});
 }
 
 void ObjWavefront::setMaterial(Material& material) {
+	std::shared_ptr<ObjGeometry> variant;
+
+	// Shared geometry switches to a shared variant with this material,
+	// which is built once per material name instead of once per copy
+	if (this->geometry.use_count() > 1) {
+		variant = this->geometry->material_variants[material.name];
+		if (variant == nullptr) {
+			ObjWavefront copy;
+			copy.geometry = this->geometry->clone();
+			copy.setMaterial(material);
+			variant = copy.geometry;
+			this->geometry->material_variants[material.name] = variant;
+		}
+		this->materials.clear();
+		this->materials[material.name] = material;
+		this->geometry = variant;
+		return;
+	}
+
 	this->clearMaterials();
-	for (int i = 0; i < this->surface_count; i++) {
+	for (int i = 0; i < this->geometry->surfaces.size(); i++) {
 		this->setSurfaceMaterial(i, material);
 	}
 }
 
 void ObjWavefront::clearMaterials() {
+	this->makeUnique();
 	this->materials.clear();
-	for (int i = 0; i < this->surface_count; i++) {
-		this->surfaces[i].material_refs->clear();
+	for (Surface& surface : this->geometry->surfaces) {
+		surface.material_ranges.clear();
 	}
 }
 
 void ObjWavefront::clear() {
-	if (this->verts != NULL) std::free(this->verts);
-	if (this->norms != NULL) std::free(this->norms);
-	if (this->uvs != NULL) std::free(this->uvs);
-	if (this->surfaces != NULL) {
-		for (int i = 0; i < this->surface_count; i++) {
-			this->surfaces[i].clear();
-		}
-		std::free(this->surfaces);
-	}
+	// Shared geometry is freed once its last copy lets go
+	this->geometry = std::make_shared<ObjGeometry>();
 	this->materials.clear();
 	this->name.clear();
-	this->vert_count = 0;
-	this->norm_count = 0;
-	this->uv_count = 0;
-	this->surface_count = 0;
-}
-
-void ObjWavefront::operator=(const ObjWavefront& obj) {
-	int i, j;
-
-	this->ul_id = obj.ul_id;
-	this->name = obj.name;
-	this->vert_count = obj.vert_count;
-	this->norm_count = obj.norm_count;
-	this->uv_count = obj.uv_count;
-	this->surface_count = obj.surface_count;
-	this->materials = obj.materials;
-
-	if (this->vert_count > 0) {
-		this->verts = (Vector3*)malloc(sizeof(Vector3) * this->vert_count);
-		if (this->verts == NULL) {
-			this->clear();
-			throw AllocationException("vertices", this->vert_count);
-		}
-	}
-	if (this->norm_count > 0) {
-		this->norms = (Vector3*)malloc(sizeof(Vector3) * this->norm_count);
-		if (this->norms == NULL) {
-			this->clear();
-			throw AllocationException("normals", this->norm_count);
-		}
-	}
-	if (this->uv_count > 0) {
-		this->uvs = (Vector2*)malloc(sizeof(Vector2) * this->uv_count);
-		if (this->uvs == NULL) {
-			this->clear();
-			throw AllocationException("UVs", this->uv_count);
-		}
-	}
-	if (this->surface_count > 0) {
-		this->surfaces = (Surface*)malloc(sizeof(Surface) * this->surface_count);
-		if (this->surfaces == NULL) {
-			this->clear();
-			throw AllocationException("normals", this->surface_count);
-		}
-	}
-
-	for (i = 0; i < this->vert_count; i++) {
-		this->verts[i] = obj.verts[i];
-	}
-	for (i = 0; i < this->norm_count; i++) {
-		this->norms[i] = obj.norms[i];
-	}
-	for (i = 0; i < this->uv_count; i++) {
-		this->uvs[i] = obj.uvs[i];
-	}
-	for (i = 0; i < this->surface_count; i++) {
-		this->surfaces[i].material_refs = new std::unordered_map<int, std::string>();
-		this->surfaces[i].face_count = obj.surfaces[i].face_count;
-		this->surfaces[i].faces = NULL;
-		if (this->surfaces[i].face_count > 0) {
-			this->surfaces[i].faces = (Face*)malloc(sizeof(Face) * this->surfaces[i].face_count);
-			if (this->surfaces[i].faces == NULL) {
-				this->clear();
-				throw AllocationException("surface faces", this->surfaces[i].face_count);
-			}
-			for (j = 0; j < this->surfaces[i].face_count; j++) {
-				this->surfaces[i].faces[j] = obj.surfaces[i].faces[j];
-			}
-		}
-	}
-}
\ No newline at end of file
+}
@@ -3,7 +3,12 @@
 
 #include <string>
 #include <vector>
+#include <cstdint>
+#include <atomic>
+#include <fstream>
+#include <memory>
 #include <unordered_map>
+#include <unordered_set>
 
 #include "space.hpp"
 
@@ -30,6 +35,9 @@ enum class ObjReadState {
 	FACES
 };
 
+/// Packed material identity: quantized diffuse (24 bits), emissive (24 bits), and dissolve (16 bits)
+typedef uint64_t MaterialKey;
+
 class Material {
 public:
 	IllumModel illum_model;
@@ -44,15 +52,29 @@ public:
 
 	static std::vector<Material> load(const char* filename);
 	static void save(const char* filename, const std::vector<const Material*>& materials);
-	static std::string getColorHashString(Vector3 color);
 
 	Material();
 	Material(const char* name);
 
+	MaterialKey getKey() const;
+
 	bool operator==(const Material& mat) const;
 	bool operator!=(const Material& mat) const;
 };
 
+/// Interns materials by MaterialKey, each unique key gets a stable index
+class MaterialTable {
+public:
+	std::vector<Material> materials;
+	std::unordered_map<MaterialKey, int> index;
+
+	int intern(const Material& material);
+	void clear();
+};
+
+extern MaterialTable material_table;
+extern std::atomic<uint32_t> NEXT_UL_ID;
+
 class Face {
 public:
 	int vert_index[3];
@@ -60,32 +82,54 @@ public:
 	int uv_index[3];
 };
 
+/// Faces from face_start up to the next range's face_start use material name
+class MaterialRange {
+public:
+	int face_start;
+	std::string name;
+};
+
 class Surface {
 public:
-	int face_count;
-	Face* faces;
-	std::unordered_map<int, std::string>* material_refs;
-	
-	~Surface();
-	void clear();
+	std::vector<Face> faces;
+	// Sorted by face_start, like OBJ usemtl a material carries over into following surfaces
+	std::vector<MaterialRange> material_ranges;
+
+	int removeFaces(const std::vector<bool>& remove);
+};
+
+/// Geometry storage, shared by ObjWavefront copies until one of them mutates
+/// (see ObjWavefront::makeUnique). Move-only, use clone for a deep copy.
+class ObjGeometry {
+public:
+	std::vector<Vector3> verts;
+	std::vector<Vector3> norms;
+	std::vector<Vector2> uvs;
+	std::vector<Surface> surfaces;
+	// Same geometry with a single material on every surface, by material name
+	std::unordered_map<std::string, std::shared_ptr<ObjGeometry>> material_variants;
+
+	ObjGeometry() = default;
+	ObjGeometry(const ObjGeometry&) = delete;
+	ObjGeometry(ObjGeometry&&) = default;
+	ObjGeometry& operator=(const ObjGeometry&) = delete;
+	ObjGeometry& operator=(ObjGeometry&&) = default;
+
+	std::shared_ptr<ObjGeometry> clone() const;
 };
 
+/// Copies share geometry and are cheap, moves hand it over without touching the arrays
 class ObjWavefront {
 public:
 	uint32_t ul_id;
-	int vert_count;
-	int norm_count;
-	int uv_count;
-	int surface_count;
-	Vector3* verts;
-	Vector3* norms;
-	Vector2* uvs;
-	Surface* surfaces;
 	std::string name;
 	std::unordered_map<std::string, Material> materials;
+	// Never null, may be shared, call makeUnique before mutating
+	std::shared_ptr<ObjGeometry> geometry;
 	
 	ObjWavefront();
-	~ObjWavefront();
+
+	void makeUnique();
 
 	void offset(const Vector3& offset, bool cache);
 	void load(const char* filename, bool cache);
@@ -95,8 +139,27 @@ public:
 	void setMaterial(Material& material);
 	void clearMaterials();
 	void clear();
+};
+
+/// Writes objects one after another into a single OBJ and MTL.
+/// Face indices continue from earlier objects, materials are shared through material_table.
+class ObjStreamWriter {
+public:
+	std::ofstream file;
+	std::string base_dir;
+	std::string mat_filename;
+	int vert_offset;
+	int norm_offset;
+	int uv_offset;
+	// material_table indices referenced so far, in order of first use
+	std::vector<int> material_indices;
+	std::unordered_set<int> material_used;
+
+	ObjStreamWriter();
 
-	void operator=(const ObjWavefront& obj);
+	void open(const char* filename);
+	void write(const ObjWavefront& obj, const std::string& object_name, const std::string& group_name);
+	void close();
 };
 
 #endif // OBJWAVEFRONT_H
\ No newline at end of file
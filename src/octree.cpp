@@ -32,14 +32,13 @@ ObjWavefront* octreeDebugPrepareMesh() {
 	mat->diffuse = Vector3(0.25f, 0.9f, 0.9f);
 	mat->dissolve = 0.01f;
 	mesh->materials[mat->name] = *mat;
-	mesh->vert_count = 0;
-	mesh->norm_count = 6;
-	mesh->norms = (Vector3*)malloc(sizeof(Vector3) * 6);
-	mesh->norms[0] = Vector3(0.0f, 1.0f, 0.0f);
-	mesh->norms[1] = Vector3(0.0f, -1.0f, 0.0f);
-	mesh->norms[2] = Vector3(1.0f, 0.0f, 0.0f);
-	mesh->norms[3] = Vector3(-1.0f, 0.0f, 0.0f);
-	mesh->norms[4] = Vector3(0.0f, 0.0f, 1.0f);
-	mesh->norms[5] = Vector3(0.0f, 0.0f, -1.0f);
+	mesh->geometry->norms = {
+		Vector3(0.0f, 1.0f, 0.0f),
+		Vector3(0.0f, -1.0f, 0.0f),
+		Vector3(1.0f, 0.0f, 0.0f),
+		Vector3(-1.0f, 0.0f, 0.0f),
+		Vector3(0.0f, 0.0f, 1.0f),
+		Vector3(0.0f, 0.0f, -1.0f)
+	};
 	return mesh;
 }
\ No newline at end of file
@@ -290,89 +290,84 @@ void octreeDebugAddToMesh(const Octree<T>* octree, ObjWavefront* mesh) {
 			}
 		}
 	}
-	mesh->verts = (Vector3*)realloc(mesh->verts, sizeof(Vector3) * (mesh->vert_count + 8));
-	for (i = 0; i < 8; i++) {
-		mesh->verts[i + mesh->vert_count] = nv[i];
-	}
-	mesh->surfaces = (Surface*)realloc(mesh->surfaces, sizeof(Surface) * (mesh->surface_count + 1));
-	mesh->surfaces[mesh->surface_count].material_refs = new std::unordered_map<int, std::string>();
-	(*mesh->surfaces[mesh->surface_count].material_refs)[0] = std::string("mat_01");
-	mesh->surfaces[mesh->surface_count].faces = (Face*)malloc(sizeof(Face) * 12);
-	mesh->surfaces[mesh->surface_count].face_count = 12;
+	ObjGeometry& geometry = *mesh->geometry;
+	int vert_count = geometry.verts.size();
+	geometry.verts.insert(geometry.verts.end(), nv.begin(), nv.end());
+	Surface& surface = geometry.surfaces.emplace_back();
+	surface.material_ranges.push_back({0, std::string("mat_01")});
+	surface.faces.resize(12);
 	// Bottom faces
 	for (i = 0; i < 2; i++) {
 		for (j = 0; j < 3; j++) {
-			mesh->surfaces[mesh->surface_count].faces[i].norm_index[j] = 2;
+			surface.faces[i].norm_index[j] = 2;
 		}
 	}
-	mesh->surfaces[mesh->surface_count].faces[0].vert_index[0] = 1 + mesh->vert_count;
-	mesh->surfaces[mesh->surface_count].faces[0].vert_index[1] = 2 + mesh->vert_count;
-	mesh->surfaces[mesh->surface_count].faces[0].vert_index[2] = 5 + mesh->vert_count;
-	mesh->surfaces[mesh->surface_count].faces[1].vert_index[0] = 6 + mesh->vert_count;
-	mesh->surfaces[mesh->surface_count].faces[1].vert_index[1] = 5 + mesh->vert_count;
-	mesh->surfaces[mesh->surface_count].faces[1].vert_index[2] = 2 + mesh->vert_count;
+	surface.faces[0].vert_index[0] = 1 + vert_count;
+	surface.faces[0].vert_index[1] = 2 + vert_count;
+	surface.faces[0].vert_index[2] = 5 + vert_count;
+	surface.faces[1].vert_index[0] = 6 + vert_count;
+	surface.faces[1].vert_index[1] = 5 + vert_count;
+	surface.faces[1].vert_index[2] = 2 + vert_count;
 	// Top faces
 	for (i = 2; i < 4; i++) {
 		for (j = 0; j < 3; j++) {
-			mesh->surfaces[mesh->surface_count].faces[i].norm_index[j] = 1;
+			surface.faces[i].norm_index[j] = 1;
 		}
 	}
-	mesh->surfaces[mesh->surface_count].faces[2].vert_index[0] = 3 + mesh->vert_count;
-	mesh->surfaces[mesh->surface_count].faces[2].vert_index[1] = 4 + mesh->vert_count;
-	mesh->surfaces[mesh->surface_count].faces[2].vert_index[2] = 7 + mesh->vert_count;
-	mesh->surfaces[mesh->surface_count].faces[3].vert_index[0] = 8 + mesh->vert_count;
-	mesh->surfaces[mesh->surface_count].faces[3].vert_index[1] = 7 + mesh->vert_count;
-	mesh->surfaces[mesh->surface_count].faces[3].vert_index[2] = 4 + mesh->vert_count;
+	surface.faces[2].vert_index[0] = 3 + vert_count;
+	surface.faces[2].vert_index[1] = 4 + vert_count;
+	surface.faces[2].vert_index[2] = 7 + vert_count;
+	surface.faces[3].vert_index[0] = 8 + vert_count;
+	surface.faces[3].vert_index[1] = 7 + vert_count;
+	surface.faces[3].vert_index[2] = 4 + vert_count;
 	// Right faces
 	for (i = 4; i < 6; i++) {
 		for (j = 0; j < 3; j++) {
-			mesh->surfaces[mesh->surface_count].faces[i].norm_index[j] = 3;
+			surface.faces[i].norm_index[j] = 3;
 		}
 	}
-	mesh->surfaces[mesh->surface_count].faces[4].vert_index[0] = 5 + mesh->vert_count;
-	mesh->surfaces[mesh->surface_count].faces[4].vert_index[1] = 6 + mesh->vert_count;
-	mesh->surfaces[mesh->surface_count].faces[4].vert_index[2] = 8 + mesh->vert_count;
-	mesh->surfaces[mesh->surface_count].faces[5].vert_index[0] = 8 + mesh->vert_count;
-	mesh->surfaces[mesh->surface_count].faces[5].vert_index[1] = 7 + mesh->vert_count;
-	mesh->surfaces[mesh->surface_count].faces[5].vert_index[2] = 5 + mesh->vert_count;
+	surface.faces[4].vert_index[0] = 5 + vert_count;
+	surface.faces[4].vert_index[1] = 6 + vert_count;
+	surface.faces[4].vert_index[2] = 8 + vert_count;
+	surface.faces[5].vert_index[0] = 8 + vert_count;
+	surface.faces[5].vert_index[1] = 7 + vert_count;
+	surface.faces[5].vert_index[2] = 5 + vert_count;
 	// Left faces
 	for (i = 6; i < 8; i++) {
 		for (j = 0; j < 3; j++) {
-			mesh->surfaces[mesh->surface_count].faces[i].norm_index[j] = 4;
+			surface.faces[i].norm_index[j] = 4;
 		}
 	}
-	mesh->surfaces[mesh->surface_count].faces[6].vert_index[0] = 1 + mesh->vert_count;
-	mesh->surfaces[mesh->surface_count].faces[6].vert_index[1] = 2 + mesh->vert_count;
-	mesh->surfaces[mesh->surface_count].faces[6].vert_index[2] = 4 + mesh->vert_count;
-	mesh->surfaces[mesh->surface_count].faces[7].vert_index[0] = 4 + mesh->vert_count;
-	mesh->surfaces[mesh->surface_count].faces[7].vert_index[1] = 3 + mesh->vert_count;
-	mesh->surfaces[mesh->surface_count].faces[7].vert_index[2] = 1 + mesh->vert_count;
+	surface.faces[6].vert_index[0] = 1 + vert_count;
+	surface.faces[6].vert_index[1] = 2 + vert_count;
+	surface.faces[6].vert_index[2] = 4 + vert_count;
+	surface.faces[7].vert_index[0] = 4 + vert_count;
+	surface.faces[7].vert_index[1] = 3 + vert_count;
+	surface.faces[7].vert_index[2] = 1 + vert_count;
 	// Front faces
 	for (i = 8; i < 10; i++) {
 		for (j = 0; j < 3; j++) {
-			mesh->surfaces[mesh->surface_count].faces[i].norm_index[j] = 5;
+			surface.faces[i].norm_index[j] = 5;
 		}
 	}
-	mesh->surfaces[mesh->surface_count].faces[8].vert_index[0] = 2 + mesh->vert_count;
-	mesh->surfaces[mesh->surface_count].faces[8].vert_index[1] = 6 + mesh->vert_count;
-	mesh->surfaces[mesh->surface_count].faces[8].vert_index[2] = 8 + mesh->vert_count;
-	mesh->surfaces[mesh->surface_count].faces[9].vert_index[0] = 8 + mesh->vert_count;
-	mesh->surfaces[mesh->surface_count].faces[9].vert_index[1] = 4 + mesh->vert_count;
-	mesh->surfaces[mesh->surface_count].faces[9].vert_index[2] = 2 + mesh->vert_count;
+	surface.faces[8].vert_index[0] = 2 + vert_count;
+	surface.faces[8].vert_index[1] = 6 + vert_count;
+	surface.faces[8].vert_index[2] = 8 + vert_count;
+	surface.faces[9].vert_index[0] = 8 + vert_count;
+	surface.faces[9].vert_index[1] = 4 + vert_count;
+	surface.faces[9].vert_index[2] = 2 + vert_count;
 	// Back faces
 	for (i = 10; i < 12; i++) {
 		for (j = 0; j < 3; j++) {
-			mesh->surfaces[mesh->surface_count].faces[i].norm_index[j] = 6;
+			surface.faces[i].norm_index[j] = 6;
 		}
 	}
-	mesh->surfaces[mesh->surface_count].faces[10].vert_index[0] = 1 + mesh->vert_count;
-	mesh->surfaces[mesh->surface_count].faces[10].vert_index[1] = 5 + mesh->vert_count;
-	mesh->surfaces[mesh->surface_count].faces[10].vert_index[2] = 7 + mesh->vert_count;
-	mesh->surfaces[mesh->surface_count].faces[11].vert_index[0] = 7 + mesh->vert_count;
-	mesh->surfaces[mesh->surface_count].faces[11].vert_index[1] = 3 + mesh->vert_count;
-	mesh->surfaces[mesh->surface_count].faces[11].vert_index[2] = 1 + mesh->vert_count;
-	mesh->surface_count += 1;
-	mesh->vert_count += 8;
+	surface.faces[10].vert_index[0] = 1 + vert_count;
+	surface.faces[10].vert_index[1] = 5 + vert_count;
+	surface.faces[10].vert_index[2] = 7 + vert_count;
+	surface.faces[11].vert_index[0] = 7 + vert_count;
+	surface.faces[11].vert_index[1] = 3 + vert_count;
+	surface.faces[11].vert_index[2] = 1 + vert_count;
 	for (const Octree<FaceData>& div : octree->subdivisions) {
 		octreeDebugAddToMesh<T>(&div, mesh);
 	}
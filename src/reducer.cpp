@@ -12,102 +12,79 @@
 const float MIN_TRIANGLE_AREA_SQ = NEAR_ZERO * NEAR_ZERO;
 
 int reduceFaces(ObjWavefront& mesh, Surface& surface) {
-	int i, remove_count;
+	int i;
 	float squared_area;
-	Vector3 *p1, *p2, *p3;
-	Face* hold;
+	const Vector3 *p1, *p2, *p3;
+	const std::vector<Vector3>& verts = mesh.geometry->verts;
 	Vector3 area;
+	std::vector<bool> remove(surface.faces.size(), false);
 
-	// Ignore degenerate triangle faces, shifting to remove
+	// Ignore degenerate triangle faces
 	// Use squared area to check
-	remove_count = 0;
-	for (i = 0; i < surface.face_count; i++) {
-		p1 = &mesh.verts[surface.faces[i].vert_index[0] - 1];
-		p2 = &mesh.verts[surface.faces[i].vert_index[1] - 1];
-		p3 = &mesh.verts[surface.faces[i].vert_index[2] - 1];
+	for (i = 0; i < surface.faces.size(); i++) {
+		p1 = &verts[surface.faces[i].vert_index[0] - 1];
+		p2 = &verts[surface.faces[i].vert_index[1] - 1];
+		p3 = &verts[surface.faces[i].vert_index[2] - 1];
 		area = (*p2 - *p1).cross(*p3 - *p1);
 		squared_area = area.dot(area) * 0.25f;
-		if (squared_area <= MIN_TRIANGLE_AREA_SQ) {
-			remove_count += 1;
-			continue;
-		}
-		surface.faces[i - remove_count] = surface.faces[i];
+		remove[i] = squared_area <= MIN_TRIANGLE_AREA_SQ;
 	}
 
-	// Realloc faces unless empty (delete surface)
-	surface.face_count -= remove_count;
-	if (surface.face_count == 0) {
-		surface.clear();
-	} else {
-		hold = (Face*)realloc(surface.faces, surface.face_count * sizeof(Face));
-		if (hold == NULL) {
-			throw ReallocException("faces post-join", surface.face_count);
-		}
-		surface.faces = hold;
-	}
-	return remove_count;
+	return surface.removeFaces(remove);
 }
 
 int reduceSurfaces(ObjWavefront& mesh) {
-	int i, offset, removed_surfaces;
-	Surface* hold;
-	std::vector<bool> keep(mesh.surface_count, true);
+	int i, removed_surfaces;
 
-	// Reduce surface faces, mark surface as removed if empty
+	mesh.makeUnique();
+	std::vector<Surface>& surfaces = mesh.geometry->surfaces;
+	// Reduce surface faces, drop surface if empty
 	removed_surfaces = 0;
-	for (i = 0; i < mesh.surface_count; i++) {
-		reduceFaces(mesh, mesh.surfaces[i]);
-		if (mesh.surfaces[i].face_count == 0) {
-			removed_surfaces += 1;
-			keep[i] = false;
+	for (i = 0; i < surfaces.size(); i++) {
+		reduceFaces(mesh, surfaces[i]);
+		if (surfaces[i].faces.size() > 0) {
+			if (removed_surfaces > 0) surfaces[i - removed_surfaces] = std::move(surfaces[i]);
+			continue;
 		}
-	}
-
-	// Update surfaces then realloc or free as needed
-	offset = 0;
-	for (i = 0; i < mesh.surface_count; i++) {
-		if (!keep[i]) offset += 1;
-		if (i + offset >= mesh.surface_count) break;
-		mesh.surfaces[i] = mesh.surfaces[i + offset];
-	}
-	mesh.surface_count -= removed_surfaces;
-	if (mesh.surface_count == 0) {
-		free(mesh.surfaces);
-	} else {
-		hold = (Surface*)realloc(mesh.surfaces, mesh.surface_count * sizeof(Surface));
-		if (hold == NULL) {
-			throw ReallocException("surfaces post-join", mesh.surface_count);
+		// Carry the last material over, following surfaces may rely on it
+		if (surfaces[i].material_ranges.size() > 0 && i + 1 < surfaces.size()) {
+			std::vector<MaterialRange>& next = surfaces[i + 1].material_ranges;
+			if (next.size() == 0 || next[0].face_start > 0) {
+				next.insert(next.begin(), {0, surfaces[i].material_ranges.back().name});
+			}
 		}
-		mesh.surfaces = hold;
+		removed_surfaces += 1;
 	}
+	surfaces.resize(surfaces.size() - removed_surfaces);
+	surfaces.shrink_to_fit();
 
 	return removed_surfaces;
 }
 
 int joinVertInMesh(ObjWavefront& mesh, float min_dist) {
-	if (mesh.vert_count == 0) return 0;
+	if (mesh.geometry->verts.size() == 0) return 0;
 
-	int i, j, k, avg_count, remove_count;
+	int i, k, avg_count, remove_count;
 	float min_dist_sq, dist_sq;
-	Surface* surface;
-	Face* face;
-	Vector3* hold;
 	Vector3 diff;
 	Vector3 avg;
-	std::vector<bool> keep(mesh.vert_count, true);
+	std::vector<bool> keep(mesh.geometry->verts.size(), true);
 	std::unordered_map<int, int> index_remap;
 	std::unordered_set<OctreeItem<VertData>*> visited;
 	std::unordered_set<OctreeItem<VertData>*> unique_neighbors;
 	std::vector<OctreeItem<VertData>*> items;
 	Octree<VertData>* octree;
 
+	mesh.makeUnique();
+	std::vector<Vector3>& verts = mesh.geometry->verts;
+
 	// Some distance checks use squared distance
 	min_dist_sq = min_dist * min_dist;
 
 	// TODO: Move octree instances outside of joinVertInMesh (mirror of scene)
 	// TODO: Switch octree to be mesh > surface > material > faces (not individual verts)
-	for (i = 0; i < mesh.vert_count; i++) {
-		items.push_back(new OctreeItem<VertData>(mesh.verts[i], Vector3()));
+	for (i = 0; i < verts.size(); i++) {
+		items.push_back(new OctreeItem<VertData>(verts[i], Vector3()));
 		items.back()->data = new VertData();
 		items.back()->data->index = i;
 	}
@@ -121,26 +98,26 @@ int joinVertInMesh(ObjWavefront& mesh, float min_dist) {
 		visited.insert(item);
 		unique_neighbors.clear();
 		avg_count = 1;
-		avg = mesh.verts[item->data->index];
+		avg = verts[item->data->index];
 		for (Octree<VertData>* parent : item->parents) {
 			for (OctreeItem<VertData>* neighbor : parent->children) {
 				// Ignore self / redundant checks
 				if (visited.find(neighbor) != visited.end()) continue;
 				if (!unique_neighbors.insert(neighbor).second) continue;
 				// Check if neighbor position is within min dist (squared distances).
-				diff = mesh.verts[item->data->index] - mesh.verts[neighbor->data->index];
+				diff = verts[item->data->index] - verts[neighbor->data->index];
 				dist_sq = diff.dot(diff);
 				if (dist_sq <= min_dist_sq) {
 					index_remap[neighbor->data->index] = item->data->index;
 					keep[neighbor->data->index] = false;
 					avg_count += 1;
-					avg = avg + mesh.verts[neighbor->data->index];
+					avg = avg + verts[neighbor->data->index];
 				}
 			}
 		}
 		// Merge to avg
 		if (avg_count > 1) {
-			mesh.verts[item->data->index] = avg * (1.0f / avg_count);
+			verts[item->data->index] = avg * (1.0f / avg_count);
 		}
 	}
 	visited.clear();
@@ -150,11 +127,11 @@ int joinVertInMesh(ObjWavefront& mesh, float min_dist) {
 
 	// Update vertices then realloc
 	remove_count = 0;
-	for (i = 0; i < mesh.vert_count; i++) {
+	for (i = 0; i < verts.size(); i++) {
 		// Increment remove_count for vertices marked as removed (not kept).
 		// Use i - remove_count to shift the original vertex into the correct position.
 		if (!keep[i]) remove_count += 1;
-		else mesh.verts[i - remove_count] = mesh.verts[i];
+		else verts[i - remove_count] = verts[i];
 		// For any vertex already in index_remap (merged to point at earlier vertex)
 		// update its mapping (due to shift in reference)
 		// If a vertex was merged (not kept and already in index_remap),
@@ -164,21 +141,15 @@ int joinVertInMesh(ObjWavefront& mesh, float min_dist) {
 		// For untouched vertices, set their mapping based on the current shift.
 		} else index_remap[i] = i - remove_count;
 	}
-	mesh.vert_count = mesh.vert_count - remove_count;
-	hold = (Vector3*)realloc(mesh.verts, mesh.vert_count * sizeof(Vector3));
-	if (hold == NULL) {
-		throw ReallocException("vertices post-join", mesh.vert_count);
-	}
-	mesh.verts = hold;
+	verts.resize(verts.size() - remove_count);
+	verts.shrink_to_fit();
 	keep.clear();
 
 	// Update surface[].faces indices
-	for (i = 0; i < mesh.surface_count; i++) {
-		surface = &mesh.surfaces[i];
-		for (j = 0; j < surface->face_count; j++) {
-			face = &surface->faces[j];
+	for (Surface& surface : mesh.geometry->surfaces) {
+		for (Face& face : surface.faces) {
 			for(k = 0; k < 3; k++) {
-				face->vert_index[k] = index_remap[face->vert_index[k] - 1] + 1;
+				face.vert_index[k] = index_remap[face.vert_index[k] - 1] + 1;
 			}
 		}
 	}
@@ -191,38 +162,41 @@ int joinVertInMesh(ObjWavefront& mesh, float min_dist) {
 }
 
 int removeFacesInMesh(ObjWavefront& mesh, float min_dist) {
-	if (mesh.vert_count == 0 || mesh.surface_count == 0) return 0;
+	if (mesh.geometry->verts.size() == 0 || mesh.geometry->surfaces.size() == 0) return 0;
 
 	bool covered, shared_point;
-	int i, j, k, remove_count, surface_remove_count;
+	int i, j, k, remove_count;
 	float min_dist_sq, point_dist, plane_dist;
 	float one_third = 1.0f / 3.0f;
-	Surface* surface;
 	FaceData* face_data;
 	Vector3 min, max, center, diff;
 	Vector3 points[3];
-	std::unordered_map<Surface*, std::unordered_set<int>> faces_to_remove;
+	std::unordered_map<Surface*, std::vector<bool>> faces_to_remove;
 	std::unordered_set<Vector3*> opposing_points;
 	std::unordered_set<OctreeItem<FaceData>*> not_covered;
 	std::unordered_set<OctreeItem<FaceData>*> unique_neighbors;
 	std::vector<OctreeItem<FaceData>*> items;
 	Octree<FaceData>* octree;
 
+	mesh.makeUnique();
+	std::vector<Vector3>& verts = mesh.geometry->verts;
+	std::vector<Surface>& surfaces = mesh.geometry->surfaces;
+
 	// Some distance checks use squared distance
 	min_dist_sq = min_dist * min_dist;
 
 	remove_count = 0;
-	for (i = 0; i < mesh.surface_count; i++) {
+	for (i = 0; i < surfaces.size(); i++) {
 		// Create an octree of face data to localize the mesh surface
-		items.reserve(mesh.surfaces[i].face_count);
-		for (j = 0; j < mesh.surfaces[i].face_count; j++) {
+		items.reserve(surfaces[i].faces.size());
+		for (j = 0; j < surfaces[i].faces.size(); j++) {
 			face_data = new FaceData();
 			face_data->mesh_ref = &mesh;
-			face_data->surface_ref = &mesh.surfaces[i];
-			face_data->face_ref = &mesh.surfaces[i].faces[j];
+			face_data->surface_ref = &surfaces[i];
+			face_data->face_ref = &surfaces[i].faces[j];
 			face_data->face_index = j;
 			for (k = 0; k < 3; k++) {
-				face_data->points[k] = &mesh.verts[face_data->face_ref->vert_index[k] - 1];
+				face_data->points[k] = &verts[face_data->face_ref->vert_index[k] - 1];
 				points[k] = *face_data->points[k];
 			}
 			face_data->normal = (points[1] - points[0]).cross(points[2] - points[1]);
@@ -279,7 +253,9 @@ int removeFacesInMesh(ObjWavefront& mesh, float min_dist) {
 				}
 				// If covered, mark face for removal
 				if (covered) {
-					faces_to_remove[item->data->surface_ref].insert(item->data->face_index);
+					std::vector<bool>& remove = faces_to_remove[item->data->surface_ref];
+					if (remove.size() == 0) remove.resize(item->data->surface_ref->faces.size(), false);
+					remove[item->data->face_index] = true;
 				// If uncovered, add it to list of neighbors to ignore
 				} else {
 					not_covered.insert(item);
@@ -293,25 +269,7 @@ int removeFacesInMesh(ObjWavefront& mesh, float min_dist) {
 
 	// Remove faces marked for removal (do not remove vertices)
 	for (auto& fr : faces_to_remove) {
-		surface = fr.first;
-		surface_remove_count = 0;
-		// Iterate each surface's face, shift back on removal
-		for (j = 0; j < surface->face_count; j++) {
-			if (fr.second.find(j) != fr.second.end()) {
-				surface_remove_count += 1;
-				continue;
-			}
-			surface->faces[j - surface_remove_count] = surface->faces[j];
-		}
-		// Realloc surface
-		if (surface_remove_count > 0) {
-			surface->face_count -= surface_remove_count;
-			surface->faces = (Face*)realloc(surface->faces, sizeof(Face) * surface->face_count);
-			if (surface->faces == NULL) {
-				throw ReallocException("faces post-face-remove", surface->face_count);
-			}
-		}
-		remove_count += surface_remove_count;
+		remove_count += fr.first->removeFaces(fr.second);
 	}
 	faces_to_remove.clear();
 
@@ -327,7 +285,7 @@ int removeSceneInternalFaces(Node& scene, float min_dist) {
 		if (scene.children[i]->type == NodeType::MeshObj) {
 			mnode = ((MeshObj*)scene.children[i]);
 			remove_count += removeFacesInMesh(mnode->mesh, min_dist);
-			if (mnode->mesh.surface_count == 0) empty_meshes.push_back(i);
+			if (mnode->mesh.geometry->surfaces.size() == 0) empty_meshes.push_back(i);
 		} else {
 			remove_count += removeSceneInternalFaces(*scene.children[i], min_dist);
 		}
@@ -349,7 +307,7 @@ int joinSceneRelatedVerts(Node& scene, float min_dist) {
 		if (scene.children[i]->type == NodeType::MeshObj) {
 			mnode = ((MeshObj*)scene.children[i]);
 			remove_count += joinVertInMesh(mnode->mesh, min_dist);
-			if (mnode->mesh.surface_count == 0) empty_meshes.push_back(i);
+			if (mnode->mesh.geometry->surfaces.size() == 0) empty_meshes.push_back(i);
 		} else {
 			remove_count += joinSceneRelatedVerts(*scene.children[i], min_dist);
 		}
@@ -2,12 +2,15 @@
 
 #include <iostream>
 #include <fstream>
+#include <thread>
+#include <unordered_set>
 
 #include "utils.hpp"
 #include "config.hpp"
 #include "exporter.hpp"
 #include "objwavefront.hpp"
 #include "ylands.hpp"
+#include "assetpack.hpp"
 #include "workpool.hpp"
 
 bool draw_bb;
@@ -55,6 +58,7 @@ MeshObj::MeshObj() : Node() {
 
 void nodeApplyTransforms(Node* current, Node* parent);
 void buildScene(Node* parent, const json& root);
+void prefetchSceneModels(const json& data);
 MeshObj* createMeshFromRef(const char* ref_key);
 
 Node* createSceneFromJson(const Config& config, const json& data) {
@@ -73,7 +77,18 @@ Node* createSceneFromJson(const Config& config, const json& data) {
 		throw LoadException("Failed to load \"lookup.json\": " + std::string(e.what()));
 	}
 
-	buildScene(scene, data);
+	// Models load in the background while the scene is built, see prefetchSceneModels
+	std::thread prefetch;
+	if (!asset_pack.isOpen() && std::thread::hardware_concurrency() > 1) {
+		prefetch = std::thread(prefetchSceneModels, std::cref(data));
+	}
+	try {
+		buildScene(scene, data);
+	} catch (...) {
+		if (prefetch.joinable()) prefetch.join();
+		throw;
+	}
+	if (prefetch.joinable()) prefetch.join();
 	
 	std::cout << "Scene built" << std::endl;
 	timerStopMsAndPrint(s);
@@ -83,7 +98,7 @@ Node* createSceneFromJson(const Config& config, const json& data) {
 }
 
 void transformMeshObj(MeshObj* mesh, bool full_transform) {
-	int i;
+	mesh->mesh.makeUnique();
 	if (full_transform) {
 		if (mesh->parent != NULL) {
 			mesh->position = mesh->parent->globalPosition()
@@ -91,14 +106,12 @@ void transformMeshObj(MeshObj* mesh, bool full_transform) {
 			mesh->rotation = mesh->parent->globalRotation() * mesh->rotation;
 		}
 	}
-	for (i = 0; i < mesh->mesh.vert_count; i++) {
-		mesh->mesh.verts[i] = mesh->position
-							+ (mesh->rotation
-								* (mesh->scale * mesh->mesh.verts[i]));
+	for (Vector3& vert : mesh->mesh.geometry->verts) {
+		vert = mesh->position + (mesh->rotation * (mesh->scale * vert));
 	}
-	for (i = 0; i < mesh->mesh.norm_count; i++) {
+	for (Vector3& norm : mesh->mesh.geometry->norms) {
 		// TODO: Use scaling with rotation * (norm * scale).normalized
-		mesh->mesh.norms[i] = mesh->rotation * mesh->mesh.norms[i];
+		norm = mesh->rotation * norm;
 	}
 }
 
@@ -113,6 +126,106 @@ void nodeApplyTransforms(Node* current, bool full_transform) {
 	}
 }
 
+/// Apply group's transform to child, as if child were attached to group's parent
+void foldNodeTransform(Node& group, Node& child) {
+	child.position = group.position + group.rotation * (group.scale * child.position);
+	child.rotation = group.rotation * child.rotation;
+	child.scale = group.scale * child.scale;
+}
+
+int collapseSceneHierarchy(Node& root, bool flatten) {
+	int removed = 0;
+	Node* child;
+	std::vector<Node*> children;
+
+	for (int i = 0; i < root.children.size(); i++) {
+		child = root.children[i];
+		// Bottom up, so folded grandchildren are already collapsed
+		removed += collapseSceneHierarchy(*child, flatten);
+		if (child->type != NodeType::Node) {
+			children.push_back(child);
+			continue;
+		}
+
+		// Empty branch
+		if (child->children.size() == 0) {
+			delete child;
+			removed += 1;
+			continue;
+		}
+		// Folding through a non uniform scale would skew rotated children
+		if ((child->children.size() == 1 || flatten)
+			&& child->scale.x == child->scale.y && child->scale.y == child->scale.z
+		) {
+			for (Node* grandchild : child->children) {
+				foldNodeTransform(*child, *grandchild);
+				grandchild->parent = &root;
+				children.push_back(grandchild);
+			}
+			child->children.clear();
+			delete child;
+			removed += 1;
+			continue;
+		}
+		children.push_back(child);
+	}
+
+	root.children = std::move(children);
+	return removed;
+}
+
+void collectSceneRefs(const json& root, std::unordered_set<std::string>& refs) {
+	for (auto& [key, item] : root.items()) {
+		if (item["type"] == "entity") {
+			refs.insert((std::string)item["blockdef"]);
+		}
+		if (item.contains("children")) {
+			collectSceneRefs(item["children"], refs);
+		}
+	}
+}
+
+/// Load every model the scene references into the model cache, in parallel.
+/// Resolves refs in the same order as createMeshFromRef, buildScene then only waits on
+/// models still loading. Failures are left for buildScene to hit and report.
+void prefetchSceneModels(const json& data) {
+	std::unordered_set<std::string> refs;
+	std::unordered_set<std::string> unique_files;
+	std::vector<std::string> files;
+	const json& lookup = YlandStandard::lookup;
+	const json& blockdef = YlandStandard::blockdef;
+
+	try {
+		collectSceneRefs(data, refs);
+		for (const std::string& ref_key : refs) {
+			if (!blockdef.contains(ref_key)) continue;
+			const json& block_ref = blockdef.at(ref_key);
+			std::string filename;
+			if (lookup["ids"].contains(ref_key)) {
+				filename = lookup["ids"][ref_key];
+			} else if (lookup["types"].contains(block_ref["type"])) {
+				filename = lookup["types"][(std::string)block_ref["type"]];
+			} else if (lookup["shapes"].contains(block_ref["shape"])) {
+				filename = lookup["shapes"][(std::string)block_ref["shape"]];
+			} else if (draw_bb) {
+				filename = lookup["shapes"]["CCUBE"];
+			}
+			if (filename.size() > 0 && unique_files.insert(filename).second) {
+				files.push_back(filename);
+			}
+		}
+
+		parallelFor(files.size(), 1, [&](int start, int end) {
+			ObjWavefront model;
+			for (int i = start; i < end; i++) {
+				try {
+					model.load(files[i].c_str(), true);
+				} catch (CustomException& e) {}
+			}
+		});
+	} catch (std::exception& e) {}
+}
+
 void buildScene(Node* parent, const json& root) {
 	Vector3 parent_position = parent->globalPosition();
 	Quaternion parent_rotation = parent->globalRotation();
@@ -157,11 +270,62 @@ void buildScene(Node* parent, const json& root) {
 	}
 }
 
+MeshObj* createMeshFromPack(const char* ref_key) {
+	MeshObj* mesh = NULL;
+	Material mat;
+	const AssetPackBlock* block_ref;
+
+	block_ref = asset_pack.findBlock(ref_key);
+	if (block_ref == nullptr) {
+		std::cout << "No block reference for \"" << ref_key << "\"" << std::endl;
+		return NULL;
+	}
+
+	// Lookup was resolved when the pack was built (see createMeshFromRef)
+	if (block_ref->model_index >= 0) {
+		mesh = new MeshObj();
+		asset_pack.readModel(block_ref->model_index, mesh->mesh);
+		if (block_ref->model_scaled) {
+			mesh->scale = Vector3(block_ref->size[0], block_ref->size[1], block_ref->size[2]);
+		}
+	} else if (draw_bb && asset_pack.header->bb_model_index >= 0) {
+		mesh = new MeshObj();
+		asset_pack.readModel(asset_pack.header->bb_model_index, mesh->mesh);
+		Vector3 offset = Vector3(
+			block_ref->bb_center_offset[0],
+			block_ref->bb_center_offset[1],
+			-block_ref->bb_center_offset[2]
+		);
+		mesh->scale = Vector3(
+			block_ref->bb_dimensions[0],
+			block_ref->bb_dimensions[1],
+			block_ref->bb_dimensions[2]
+		);
+		mesh->mesh.offset(offset / mesh->scale, true);
+		mat.dissolve = draw_bb_transparency;
+	}
+
+	if (mesh != NULL) {
+		if (mesh->mesh.materials.size() == 0) {
+			mat.specular = Vector3(0.0f, 0.0f, 0.0f);
+			mesh->mesh.setMaterial(mat);
+		}
+		if (block_ref->has_color) {
+			setEntityColor(*mesh, std::vector<float>(block_ref->color, block_ref->color + 4));
+		}
+	}
+
+	return mesh;
+}
+
 MeshObj* createMeshFromRef(const char* ref_key) {
 	MeshObj* mesh = NULL;
 	Material mat;
 	json block_ref;
 
+	// Precompiled lookup (see --preload) skips JSON and OBJ parsing
+	if (asset_pack.isOpen()) return createMeshFromPack(ref_key);
+
 	if (!YlandStandard::blockdef.contains(ref_key)) {
 		std::cout << "No block reference for \"" << ref_key << "\"" << std::endl;
 		return NULL;
@@ -204,8 +368,11 @@ MeshObj* createMeshFromRef(const char* ref_key) {
 	}
 
 	if (mesh != NULL) {
-		mat.specular = Vector3(0.0f, 0.0f, 0.0f);
-		mesh->mesh.setMaterial(mat);
+		// Keep authored materials (multi-material models), entity color tints the first
+		if (mesh->mesh.materials.size() == 0) {
+			mat.specular = Vector3(0.0f, 0.0f, 0.0f);
+			mesh->mesh.setMaterial(mat);
+		}
 		setEntityColor(*mesh, block_ref["colors"][0].get<std::vector<float>>());
 	}
 
@@ -29,6 +29,7 @@ public:
 	Quaternion rotation;
 	std::vector<Node*> children;
 	Node();
+	virtual ~Node() = default;
 
 	Vector3 globalPosition();
 	Quaternion globalRotation();
@@ -46,5 +47,10 @@ Node* createSceneFromJson(const Config& config, const json& data);
 /// @param current 
 /// @param parent 
 void nodeApplyTransforms(Node* current, bool full_transform);
+/// @brief Simplify the hierarchy below root, keeping every mesh's world transform.
+/// Empty groups are removed and single child groups fold into their child.
+/// @param flatten Also fold groups with several children, leaving no groups below root
+/// @return Number of group nodes removed
+int collapseSceneHierarchy(Node& root, bool flatten);
 
 #endif // SCENE_H
\ No newline at end of file
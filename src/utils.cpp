@@ -5,7 +5,19 @@
 #include <iostream>
 #include <iomanip>
 #include <vector>
+#include <charconv>
+#include <stdexcept>
 #include <time.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 #include "scene.hpp"
 #include "objwavefront.hpp"
@@ -31,13 +43,8 @@ float roundTo(float value, int places) {
 	return std::abs(rf) < NEAR_ZERO ? 0.0f : rf;
 }
 
-std::string getEntityColorUid(MeshObj& entity) {
-	std::string color_uid = "";
-	Material* mat = entity.mesh.getSurfaceMaterials(0)[0];
-	color_uid += Material::getColorHashString(mat->diffuse);
-	color_uid += "_em" + Material::getColorHashString(mat->emissive);
-	color_uid += "_d" + std::to_string(mat->dissolve);
-	return color_uid;
+uint64_t getEntityMaterialKey(MeshObj& entity) {
+	return entity.mesh.getSurfaceMaterials(0)[0]->getKey();
 }
 
 std::string hexFromInt(int value) {
@@ -126,6 +133,120 @@ std::string f_base_dir(const char* filename) {
 	return base_dir;
 }
 
+int string_split_view(std::string_view str, char delimiter, std::string_view* tokens, int max_tokens) {
+	int count = 0;
+	size_t start = 0;
+	size_t end;
+	// Like std::getline, a trailing delimiter does not produce an empty token
+	while (start < str.size()) {
+		end = str.find(delimiter, start);
+		if (end == std::string_view::npos) end = str.size();
+		if (count < max_tokens) tokens[count] = str.substr(start, end - start);
+		count += 1;
+		start = end + 1;
+	}
+	return count;
+}
+
+const char* skipNumberPrefix(const char* start, const char* end) {
+	while (start < end && std::isspace((unsigned char)*start)) start++;
+	if (start + 1 < end && start[0] == '+' && start[1] != '-') start++;
+	return start;
+}
+
+float string_to_float(std::string_view str) {
+	float value;
+	const char* end = str.data() + str.size();
+	std::from_chars_result result = std::from_chars(skipNumberPrefix(str.data(), end), end, value);
+	if (result.ec == std::errc::invalid_argument) throw std::invalid_argument("string_to_float");
+	if (result.ec == std::errc::result_out_of_range) throw std::out_of_range("string_to_float");
+	return value;
+}
+
+int string_to_int(std::string_view str) {
+	int value;
+	const char* end = str.data() + str.size();
+	std::from_chars_result result = std::from_chars(skipNumberPrefix(str.data(), end), end, value);
+	if (result.ec == std::errc::invalid_argument) throw std::invalid_argument("string_to_int");
+	if (result.ec == std::errc::result_out_of_range) throw std::out_of_range("string_to_int");
+	return value;
+}
+
+MappedFile::MappedFile() {
+	this->data = NULL;
+	this->size = 0;
+	this->file_handle = NULL;
+	this->map_handle = NULL;
+}
+
+MappedFile::~MappedFile() {
+	this->close();
+}
+
+bool MappedFile::open(const char* filename) {
+	this->close();
+#ifdef _WIN32
+	LARGE_INTEGER file_size;
+	HANDLE file = CreateFileA(
+		filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL
+	);
+	if (file == INVALID_HANDLE_VALUE) return false;
+	this->file_handle = file;
+	if (!GetFileSizeEx(file, &file_size)) {
+		this->close();
+		return false;
+	}
+	this->size = (size_t)file_size.QuadPart;
+	// Empty files cannot be mapped, leave as empty view
+	if (this->size == 0) return true;
+	this->map_handle = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (this->map_handle == NULL) {
+		this->close();
+		return false;
+	}
+	this->data = (const char*)MapViewOfFile(this->map_handle, FILE_MAP_READ, 0, 0, 0);
+#else
+	struct stat file_stat;
+	int fd = ::open(filename, O_RDONLY);
+	if (fd < 0) return false;
+	this->file_handle = (void*)(intptr_t)(fd + 1);
+	if (fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+		this->close();
+		return false;
+	}
+	this->size = (size_t)file_stat.st_size;
+	// Empty files cannot be mapped, leave as empty view
+	if (this->size == 0) return true;
+	void* view = mmap(NULL, this->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (view != MAP_FAILED) {
+		this->data = (const char*)view;
+		madvise(view, this->size, MADV_SEQUENTIAL);
+	}
+#endif
+	if (this->data == NULL) {
+		this->close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::close() {
+#ifdef _WIN32
+	if (this->data != NULL) UnmapViewOfFile(this->data);
+	if (this->map_handle != NULL) CloseHandle(this->map_handle);
+	if (this->file_handle != NULL) CloseHandle(this->file_handle);
+#else
+	if (this->data != NULL) munmap((void*)this->data, this->size);
+	// Descriptor is stored off by one so 0 can mean closed
+	if (this->file_handle != NULL) ::close((int)(intptr_t)this->file_handle - 1);
+#endif
+	this->data = NULL;
+	this->size = 0;
+	this->file_handle = NULL;
+	this->map_handle = NULL;
+}
+
 CustomException::CustomException() {}
 
 const char* CustomException::what() const noexcept {
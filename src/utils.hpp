@@ -2,6 +2,8 @@
 #define UTILS_H
 
 #include <string>
+#include <string_view>
+#include <cstdint>
 #include <sstream>
 #include <vector>
 #include <utility>
@@ -74,7 +76,7 @@ void getBounds(T* values, size_t count, T& min, T&max) {
 
 float roundTo(float value, int places);
 
-std::string getEntityColorUid(MeshObj& entity);
+uint64_t getEntityMaterialKey(MeshObj& entity);
 
 std::string hexFromInt(int value);
 template <typename T>
@@ -90,10 +92,32 @@ std::string string_ascii(const std::string& str);
 std::string string_join(const std::vector<std::string>& str_list, const char* delimiter);
 std::vector<std::string> string_split(const std::string& str, char delimiter);
 std::string string_replace(const std::string& str, const char* target, const char* repl);
+/// Same splitting as string_split, but into views of str (no allocation).
+/// Returns the full token count, only the first max_tokens are stored.
+int string_split_view(std::string_view str, char delimiter, std::string_view* tokens, int max_tokens);
+/// Same parsing and exceptions as std::stof/std::stoi (leading space, '+', trailing garbage).
+float string_to_float(std::string_view str);
+int string_to_int(std::string_view str);
 
 std::string f_base_filename_no_ext(const char* filename);
 std::string f_base_dir(const char* filename);
 
+/// Read-only view of an entire file mapped into memory
+class MappedFile {
+public:
+	const char* data;
+	size_t size;
+	MappedFile();
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	bool open(const char* filename);
+	void close();
+private:
+	void* file_handle;
+	void* map_handle;
+};
+
 class CustomException : public std::exception {
 protected:
 	std::string msg;
@@ -469,12 +469,6 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT message, WPARAM wparam, LPARAM lparam)
 						ShowWindow(hop_trans, SW_SHOW);
 					}
 					ShowWindow(hop_cmbn, SW_SHOW);
-					if (strcmp(output_type, "OBJ") == 0) {
-						SendMessage(hop_cmbn, BM_SETCHECK, BST_CHECKED, 0);
-						option_combinerel = true;
-						EnableWindow(hop_rif, true);
-						EnableWindow(hop_jv, true);
-					}
 					ShowWindow(hop_rif, SW_SHOW);
 					ShowWindow(hop_jv, SW_SHOW);
 					ShowWindow(hop_aa, SW_SHOW);
@@ -895,7 +889,7 @@ void CreateToolTips(HWND& parent) {
 "| Wavefront geometry OBJ and MTL (material) files.\n"
 "| A ready-to-render conversion of Ylands JSON data.\n"
 "| Limited by this program's supported geometry.\n"
-"| Forces \"Combine Related\" as surfaces.\n"
+"| Each mesh is written as its own object, grouped by its parent group.\n"
 "\nGLTF / GLB\n"
 "| GLTF 2.0 hierarchical geometry and BIN (binary) files.\n"
 "| A ready-to-render conversion of Ylands JSON data.\n"
@@ -914,9 +908,7 @@ void CreateToolTips(HWND& parent) {
 "Combine geometry by shared group and material.\n"
 "Recommended for large builds: reduces export complexity.\n"
 "Unless using \"Join Verticies\", individual entity\n"
-"geometry will still be retained.\n"
-"Note: OBJ exports only supports single objects; a combine\n"
-"is always done for OBJ export (grouping in surfaces)."
+"geometry will still be retained."
 	);
 	CreateToolTip(parent, hop_rif, false, max_width,
 "Only within same material (unless \"Apply To All\" checked).\n"
@@ -936,9 +928,7 @@ void CreateToolTips(HWND& parent) {
 	);
 	CreateToolTip(parent, hop_mrg, false, max_width,
 "Same as selecting \"Removal Internal Face\", \"Join Verticies\", and"
-" \"Apply To All\"\n"
-"Note: OBJ only supports single objects, so a partial merge is always done for"
-" OBJ export."
+" \"Apply To All\""
 	);
 
 	// Export Group
@@ -2,6 +2,7 @@
 
 #include <iostream>
 #include <chrono>
+#include <exception>
 #include <system_error>
 
 const int WORKER_THREAD_POLL_TIMEMS = 1;
@@ -216,4 +217,44 @@ void Workpool::addTask(std::function<void()> call, std::function<void()> callbac
 	std::lock_guard<std::mutex> lock(this->quetex);
 	this->work_queue.push(new Workitem(call, callback, errback));
 	if (this->debug) std::cout << "[Workpool] Task added to queue (" << this->work_queue.size() << ")" << std::endl;
+}
+
+void parallelFor(int count, int min_batch, const std::function<void(int start, int end)>& call) {
+	int i, start, batch;
+	int thread_count = std::thread::hardware_concurrency();
+	std::exception_ptr error = nullptr;
+	std::mutex error_mutex;
+	std::vector<std::thread> threads;
+
+	if (count <= 0) return;
+	if (min_batch < 1) min_batch = 1;
+	if (thread_count < 1) thread_count = 1;
+	if (thread_count > count / min_batch) thread_count = count / min_batch;
+	if (thread_count <= 1) {
+		call(0, count);
+		return;
+	}
+
+	batch = (count + thread_count - 1) / thread_count;
+	for (i = 0, start = 0; i < thread_count && start < count; i++, start += batch) {
+		int end = start + batch < count ? start + batch : count;
+		auto runner = [&call, &error, &error_mutex, start, end]() {
+			try {
+				call(start, end);
+			} catch (...) {
+				std::lock_guard<std::mutex> lock(error_mutex);
+				if (error == nullptr) error = std::current_exception();
+			}
+		};
+		try {
+			threads.emplace_back(runner);
+		} catch (std::system_error) {
+			// Unable to create more threads, run remaining range here
+			runner();
+		}
+	}
+	for (i = 0; i < threads.size(); i++) {
+		threads[i].join();
+	}
+	if (error != nullptr) std::rethrow_exception(error);
 }
\ No newline at end of file
@@ -6,6 +6,9 @@
 #include <mutex>
 #include <functional>
 #include <vector>
+#include <memory>
+#include <atomic>
+#include <unordered_map>
 
 class Workitem {
 public:
@@ -52,4 +55,54 @@ public:
 	void addTask(std::function<void()> call, std::function<void()> callback, std::function<void(std::exception& e)> errback);
 };
 
+/// @brief Split [0, count) into contiguous ranges and run them across hardware threads.
+/// Blocks until all ranges finish, first exception thrown by a range is rethrown.
+/// @param count total number of items
+/// @param min_batch fewest items worth handing to a thread
+/// @param call run with each [start, end) range
+void parallelFor(int count, int min_batch, const std::function<void(int start, int end)>& call);
+
+/// Lock-striped map where each value is filled exactly once.
+/// Callers racing on the same key wait for the first fill, different keys never block each other.
+/// Values are never removed, references stay valid for the life of the cache.
+template <typename K, typename V, int SHARDS = 16>
+class ShardedCache {
+private:
+	class Entry {
+	public:
+		std::atomic<bool> filled{false};
+		std::mutex mutex;
+		V value;
+	};
+	class Shard {
+	public:
+		std::mutex mutex;
+		std::unordered_map<K, std::shared_ptr<Entry>> entries;
+	};
+	Shard shards[SHARDS];
+
+public:
+	/// @brief Get value for key, running fill on first use.
+	/// If fill throws the key stays unfilled and the next caller retries.
+	const V& get(const K& key, const std::function<void(V& value)>& fill) {
+		std::shared_ptr<Entry> entry;
+		Shard& shard = this->shards[std::hash<K>()(key) % SHARDS];
+		{
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			std::shared_ptr<Entry>& slot = shard.entries[key];
+			if (slot == nullptr) slot = std::make_shared<Entry>();
+			entry = slot;
+		}
+		// Not std::call_once, libstdc++ can deadlock retrying after a throw
+		if (!entry->filled.load(std::memory_order_acquire)) {
+			std::lock_guard<std::mutex> lock(entry->mutex);
+			if (!entry->filled.load(std::memory_order_relaxed)) {
+				fill(entry->value);
+				entry->filled.store(true, std::memory_order_release);
+			}
+		}
+		return entry->value;
+	}
+};
+
 #endif // WORKPOOL_H
\ No newline at end of file
@@ -1,17 +1,42 @@
 #include "ylands.hpp"
 
+#include <iostream>
 #include <fstream>
 #include <filesystem>
 
 #include "utils.hpp"
 #include "objwavefront.hpp"
+#include "assetpack.hpp"
 
 float YlandStandard::unit = 0.375f;
 float YlandStandard::half_unit = 0.1875f;
 json YlandStandard::lookup;
 json YlandStandard::blockdef;
+std::string YlandStandard::blockdef_filename;
 
 void YlandStandard::preloadLookups(const char* filename) {
+	std::string pack_filename = getAssetPackFilename(filename);
+
+	// Prefer the precompiled pack, unless any file it was built from changed since
+	if (asset_pack.open(pack_filename.c_str())) {
+		if (asset_pack.isCurrent()) return;
+		std::cout << "Asset pack \"" << pack_filename << "\" is out of date, loading lookup instead" << std::endl;
+		asset_pack.close();
+	}
+	YlandStandard::loadLookups(filename);
+}
+
+void YlandStandard::compileLookups(const char* filename) {
+	YlandStandard::loadLookups(filename);
+	AssetPack::build(
+		getAssetPackFilename(filename).c_str(),
+		YlandStandard::lookup,
+		YlandStandard::blockdef,
+		{filename, YlandStandard::blockdef_filename}
+	);
+}
+
+void YlandStandard::loadLookups(const char* filename) {
 	std::ifstream f;
 	std::filesystem::path base_dir;
 	std::filesystem::path ref_path;
@@ -75,6 +100,7 @@ void YlandStandard::preloadLookups(const char* filename) {
 		);
 	}
 	f.close();
+	YlandStandard::blockdef_filename = YlandStandard::lookup["blockdef-file"];
 	YlandStandard::lookup.erase("blockdef-file");
 
 	if (YlandStandard::lookup.contains("base-dir")) {
@@ -13,8 +13,11 @@ public:
 	static float half_unit;
 	static json lookup;
 	static json blockdef;
+	static std::string blockdef_filename;
 
 	static void preloadLookups(const char* filename);
+	static void loadLookups(const char* filename);
+	static void compileLookups(const char* filename);
 };
 
 void setEntityColor(MeshObj& entity, const std::vector<float>& colors);